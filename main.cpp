@@ -1,8 +1,49 @@
+#define GL_GLEXT_PROTOTYPES
 #include <GL/glut.h>
+#include <GL/glext.h>
+#include <GL/glx.h>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <queue>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+
+// THREADING (asset loader)
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <atomic>
+#include <memory>
+
+// SIMD (transform kernel; falls back to plain floats when none of these is enabled)
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// POSIX (mesh cache mmap)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
 
 // LIBRARIES
 
@@ -16,293 +57,5930 @@
 // 1. STRUCTURES
 // ==========================================
 
+struct Texture {
+    std::string name;               // Path relative to models/textures/
+    GLuint id = 0;                  // 0 until uploaded (or if decoding failed)
+    size_t bytes = 0;               // GPU memory estimate (gpuTextureBytes)
+    bool loaded = false;
+    bool unloadRequested = false;
+    bool reloading = false;         // Hot reload decode in flight (HotReloadTexture)
+    bool reloadQueued = false;      // Changed again meanwhile: reload once this one lands
+};
+
+// Interleaved vertex, uploaded to the VBO as-is
+struct Vertex {
+    float px, py, pz;   // position
+    float nx, ny, nz;   // normal
+    float u, v;         // texcoord
+};
+
+// Axis-aligned box
+struct Aabb {
+    float lo[3] = {  INFINITY,  INFINITY,  INFINITY };
+    float hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+    void Grow(const Aabb& b) {
+        for (int k = 0; k < 3; k++) { lo[k] = std::min(lo[k], b.lo[k]); hi[k] = std::max(hi[k], b.hi[k]); }
+    }
+    void Grow(const float p[3]) {
+        for (int k = 0; k < 3; k++) { lo[k] = std::min(lo[k], p[k]); hi[k] = std::max(hi[k], p[k]); }
+    }
+    float Area() const {
+        float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+        return (dx < 0.0f) ? 0.0f : 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+};
+
+struct BvhNode {
+    Aabb bounds;
+    uint32_t first = 0;     // Leaf: first entry in items; inner: left child (right = first + 1)
+    uint32_t count = 0;     // Items in the leaf, 0 = inner node
+};
+
+// Bounding volume hierarchy over caller-numbered boxes (item i = box i), built
+// with binned SAH. Items move with Update() + Refit(), which only walks the
+// changed leaves up to the root; the tree shape stays until the next Build().
+class Bvh {
+public:
+    void Build(const std::vector<Aabb>& boxes, uint32_t maxLeafItems) {
+        itemBounds = boxes;
+        uint32_t n = boxes.size();
+        items.resize(n);
+        for (uint32_t i = 0; i < n; i++) items[i] = i;
+        nodes.clear();
+        parent.clear();
+        leafOf.assign(n, 0);
+        pending.clear();
+        if (n == 0) return;
+
+        std::vector<float> centroid(3 * n);
+        for (uint32_t i = 0; i < n; i++) {
+            for (int k = 0; k < 3; k++) centroid[3*i + k] = 0.5f * (boxes[i].lo[k] + boxes[i].hi[k]);
+        }
+
+        nodes.reserve(2 * n);
+        nodes.push_back(BvhNode());
+        nodes[0].count = n;
+        parent.push_back(UINT32_MAX);
+        std::vector<uint32_t> stack(1, 0);
+        while (!stack.empty()) {
+            uint32_t ni = stack.back();
+            stack.pop_back();
+            BvhNode& node = nodes[ni];
+            Aabb centers;
+            for (uint32_t k = node.first; k < node.first + node.count; k++) {
+                node.bounds.Grow(itemBounds[items[k]]);
+                centers.Grow(&centroid[3 * items[k]]);
+            }
+            if (node.count <= maxLeafItems) continue;
+
+            uint32_t mid = Split(node, centers, centroid, maxLeafItems);
+            if (mid == node.first) continue; // SAH says a leaf is cheaper
+
+            uint32_t left = nodes.size(), first = node.first, count = node.count;
+            node.first = left;
+            node.count = 0;
+            nodes.push_back(BvhNode());
+            nodes.push_back(BvhNode());
+            nodes[left].first = first;
+            nodes[left].count = mid - first;
+            nodes[left + 1].first = mid;
+            nodes[left + 1].count = first + count - mid;
+            parent.push_back(ni);
+            parent.push_back(ni);
+            stack.push_back(left + 1);
+            stack.push_back(left);
+        }
+
+        for (uint32_t ni = 0; ni < nodes.size(); ni++) {
+            const BvhNode& node = nodes[ni];
+            for (uint32_t k = node.first; k < node.first + node.count; k++) leafOf[items[k]] = ni;
+        }
+    }
+
+    // Moves an item; takes effect in the tree on the next Refit()
+    void Update(uint32_t item, const Aabb& box) {
+        itemBounds[item] = box;
+        pending.push_back(leafOf[item]);
+    }
+
+    // Re-fits the leaves touched by Update() and their ancestors, once each
+    void Refit() {
+        std::sort(pending.begin(), pending.end());
+        pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+        // Children always have higher indices than their parent, so walking the
+        // touched set from the back refits each node after all of its children
+        while (!pending.empty()) {
+            uint32_t ni = pending.back();
+            pending.pop_back();
+            BvhNode& node = nodes[ni];
+            node.bounds = Aabb();
+            if (node.count > 0) {
+                for (uint32_t k = node.first; k < node.first + node.count; k++) node.bounds.Grow(itemBounds[items[k]]);
+            } else {
+                node.bounds.Grow(nodes[node.first].bounds);
+                node.bounds.Grow(nodes[node.first + 1].bounds);
+            }
+            uint32_t p = parent[ni];
+            if (p == UINT32_MAX) continue;
+            auto at = std::lower_bound(pending.begin(), pending.end(), p);
+            if (at == pending.end() || *at != p) pending.insert(at, p);
+        }
+    }
+
+    bool Empty() const { return nodes.empty(); }
+    float RootArea() const { return nodes.empty() ? 0.0f : nodes[0].bounds.Area(); }
+    const Aabb& ItemBounds(uint32_t item) const { return itemBounds[item]; }
+
+    // Visits every item under nodes that classify(bounds) doesn't reject.
+    // classify: -1 = skip subtree, 0 = partly inside (keep testing), 1 = fully inside.
+    // visit(item, inside): inside = an ancestor was fully inside.
+    template <typename Classify, typename Visit>
+    void Traverse(Classify classify, Visit visit) const {
+        if (nodes.empty()) return;
+        std::vector<std::pair<uint32_t, bool>> stack(1, { 0, false });
+        while (!stack.empty()) {
+            uint32_t ni = stack.back().first;
+            bool inside = stack.back().second;
+            stack.pop_back();
+            const BvhNode& node = nodes[ni];
+            if (!inside) {
+                int c = classify(node.bounds);
+                if (c < 0) continue;
+                inside = c > 0;
+            }
+            if (node.count > 0) {
+                for (uint32_t k = node.first; k < node.first + node.count; k++) visit(items[k], inside);
+            } else {
+                stack.push_back({ node.first + 1, inside });
+                stack.push_back({ node.first, inside });
+            }
+        }
+    }
+
+    // Closest-hit ray query over origin + t * dir, t in [0, tMax]. hit(item, tMax)
+    // tests one item and lowers tMax when it finds something nearer. Near child first.
+    template <typename Hit>
+    void Raycast(const float origin[3], const float dir[3], float& tMax, Hit hit) const {
+        if (nodes.empty()) return;
+        float inv[3];
+        for (int k = 0; k < 3; k++) inv[k] = dir[k] != 0.0f ? 1.0f / dir[k] : 1e30f;
+
+        std::vector<std::pair<uint32_t, float>> stack;
+        float t0;
+        if (RayBox(nodes[0].bounds, origin, inv, tMax, t0)) stack.push_back({ 0, t0 });
+        while (!stack.empty()) {
+            uint32_t ni = stack.back().first;
+            float entry = stack.back().second;
+            stack.pop_back();
+            if (entry > tMax) continue; // Something nearer was hit since this was pushed
+            const BvhNode& node = nodes[ni];
+            if (node.count > 0) {
+                for (uint32_t k = node.first; k < node.first + node.count; k++) hit(items[k], tMax);
+                continue;
+            }
+            float tl, tr;
+            bool hl = RayBox(nodes[node.first].bounds, origin, inv, tMax, tl);
+            bool hr = RayBox(nodes[node.first + 1].bounds, origin, inv, tMax, tr);
+            if (hl && hr) {
+                // Far child goes on the stack first so the near one pops next
+                if (tl <= tr) { stack.push_back({ node.first + 1, tr }); stack.push_back({ node.first, tl }); }
+                else { stack.push_back({ node.first, tl }); stack.push_back({ node.first + 1, tr }); }
+            } else if (hl) stack.push_back({ node.first, tl });
+            else if (hr) stack.push_back({ node.first + 1, tr });
+        }
+    }
+
+    // Slab test; entry = where the ray enters the box (0 if it starts inside)
+    static bool RayBox(const Aabb& b, const float origin[3], const float inv[3], float tMax, float& entry) {
+        float tNear = 0.0f, tFar = tMax;
+        for (int k = 0; k < 3; k++) {
+            float t1 = (b.lo[k] - origin[k]) * inv[k];
+            float t2 = (b.hi[k] - origin[k]) * inv[k];
+            tNear = std::max(tNear, std::min(t1, t2));
+            tFar = std::min(tFar, std::max(t1, t2));
+        }
+        entry = tNear;
+        return tNear <= tFar;
+    }
+
+private:
+    static const int SAH_BINS = 12;
+
+    // Partitions the node's items at the cheapest binned SAH plane and returns the
+    // split point, or node.first when keeping the node as a leaf is cheaper
+    uint32_t Split(const BvhNode& node, const Aabb& centers, const std::vector<float>& centroid, uint32_t maxLeafItems) {
+        float bestCost = INFINITY;
+        int bestAxis = -1, bestBin = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float extent = centers.hi[axis] - centers.lo[axis];
+            if (extent <= 0.0f) continue;
+            Aabb bins[SAH_BINS];
+            uint32_t counts[SAH_BINS] = {};
+            float scale = SAH_BINS / extent;
+            for (uint32_t k = node.first; k < node.first + node.count; k++) {
+                int b = std::min(SAH_BINS - 1, (int)((centroid[3 * items[k] + axis] - centers.lo[axis]) * scale));
+                bins[b].Grow(itemBounds[items[k]]);
+                counts[b]++;
+            }
+            // Sweep from the right, then from the left: cost of splitting after bin b
+            float rightArea[SAH_BINS];
+            uint32_t rightCount[SAH_BINS];
+            Aabb acc;
+            uint32_t c = 0;
+            for (int b = SAH_BINS - 1; b > 0; b--) {
+                acc.Grow(bins[b]);
+                c += counts[b];
+                rightArea[b] = acc.Area();
+                rightCount[b] = c;
+            }
+            acc = Aabb();
+            c = 0;
+            for (int b = 0; b < SAH_BINS - 1; b++) {
+                acc.Grow(bins[b]);
+                c += counts[b];
+                if (c == 0 || rightCount[b + 1] == 0) continue;
+                float cost = acc.Area() * c + rightArea[b + 1] * rightCount[b + 1];
+                if (cost < bestCost) { bestCost = cost; bestAxis = axis; bestBin = b; }
+            }
+        }
+
+        uint32_t begin = node.first, end = node.first + node.count;
+        if (bestAxis < 0) {
+            // All centroids coincide: halve by count so big leaves still split
+            return node.count > 4 * maxLeafItems ? begin + node.count / 2 : begin;
+        }
+        if (bestCost >= node.bounds.Area() * node.count && node.count <= 4 * maxLeafItems) return begin;
+
+        float scale = SAH_BINS / (centers.hi[bestAxis] - centers.lo[bestAxis]);
+        float lo = centers.lo[bestAxis];
+        auto mid = std::partition(items.begin() + begin, items.begin() + end, [&](uint32_t item) {
+            return std::min(SAH_BINS - 1, (int)((centroid[3 * item + bestAxis] - lo) * scale)) <= bestBin;
+        });
+        return mid - items.begin();
+    }
+
+    std::vector<BvhNode> nodes;         // nodes[0] = root
+    std::vector<uint32_t> parent;
+    std::vector<uint32_t> items;        // Leaf ranges point in here
+    std::vector<Aabb> itemBounds;
+    std::vector<uint32_t> leafOf;       // Item -> leaf node
+    std::vector<uint32_t> pending;      // Nodes to refit
+};
+
+// Per-vertex tangent for normal mapping (GenerateTangents); w = bitangent sign
+struct Tangent {
+    float x, y, z, w;
+};
+
+// One level of detail: a range of Model::indices drawn against the shared vertices
+struct MeshLod {
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    float error;                    // Model-space deviation from the full mesh (0 for LOD 0)
+};
+
 struct Model {
     std::string name;
-    std::vector<float> vertices;    // x, y, z
-    std::vector<float> normals;     // nx, ny, nz
-    std::vector<float> texcoords;   // u, v
-    GLuint textureID = 0;           // OpenGL Texture ID
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices; // empty = non-indexed triangle soup
+    std::vector<MeshLod> lods;      // Indexed meshes: LOD 0 = full mesh, then coarser (BuildLodChain)
+    bool hasNormals = false;        // false -> nx/ny/nz are zero and not bound
+    bool hasTexcoords = false;      // false -> u/v are zero and not bound
+    bool normalsGenerated = false;  // Source lacked some or all; built by GenerateNormals (normalWeighting)
+    std::vector<Tangent> tangents;  // One per vertex when hasTexcoords; CPU-side only so far
+    std::string textureName;        // Diffuse map from the MTL (file name only)
+    std::string materialPath;       // MTL the OBJ pulled in ("models/..."); mesh cache key, watched for hot reload
+    Texture* texture = nullptr;     // Shared through textureRegistry
+
+    // Local-space bounds (ComputeBounds)
+    float boundsMin[3] = {0, 0, 0};
+    float boundsMax[3] = {0, 0, 0};
+    float center[3] = {0, 0, 0};    // Bounding sphere
+    float radius = 0.0f;
+
+    Bvh triangleBvh;                // Over LOD 0 triangles, built on first pick (RaycastModel)
+
+    // GPU buffers (filled once by UploadModel)
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ibo = 0;
+    GLuint instanceVBO = 0;         // Per-instance transform + color (instanced path)
+    GLsizei vertexCount = 0;
+    GLsizei indexCount = 0;         // Every LOD's indices
+    size_t gpuBytes = 0;            // Vertex + index buffers (gpuBufferBytes)
+
     bool loaded = false;
+    bool failed = false;
+    bool unloadRequested = false;   // Released while still loading; freed when the load lands
+    bool reloading = false;         // Hot reload import in flight (HotReloadModel)
+    bool reloadQueued = false;      // Changed again meanwhile: reload once this one lands
 };
 
-struct Object {
-    std::string name;
-    // Transform
-    float x = 0, y = 0, z = 0;
-    float rx = 0, ry = 0, rz = 0;
-    float sx = 1, sy = 1, sz = 1;
+// Column-major 4x4 matrix, kept as a value type so world matrices pack into one array
+struct Matrix4 {
+    float m[16];
+};
+
+// Stable reference to a scene node. Dense indices move when the store is
+// reordered; a handle doesn't, and resolves to -1 once its node is gone.
+struct ObjectHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// Scene graph stored as parallel arrays (structure of arrays), one entry per
+// node. Nodes are kept in depth-first order, so parents come before their
+// children and a node's subtree is the index range [i, subtreeEnd[i]).
+// Per-frame passes walk these arrays linearly. Groups are nodes without a model.
+struct SceneStore {
+    // Transform (local, relative to parent). Use MarkDirty() after touching it.
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> rotX, rotY, rotZ;    // Degrees
+    std::vector<float> sclX, sclY, sclZ;
+
+    // Hierarchy
+    std::vector<int32_t> parent;            // Dense index, -1 = root
+    std::vector<uint32_t> subtreeEnd;       // One past the last descendant
+
+    // Cached world matrices = parent world * local
+    std::vector<Matrix4> world;
+    std::vector<uint8_t> dirty;             // Local transform changed -> this subtree's worlds are stale
+    std::vector<uint8_t> childDirty;        // Some descendant is dirty (lets the update skip clean branches)
 
     // Animation
-    bool spinAnimation = false;     
-    float spinSpeed = 0.0f;
+    std::vector<uint8_t> spinning;
+    std::vector<float> spinSpeed;
+
+    std::vector<Model*> model;
+    std::vector<uint8_t> lod;               // LOD drawn last frame (SelectLod hysteresis)
+
+    // Cold data (selection printout, light lookup, saving)
+    std::vector<std::string> name;
+
+    uint32_t Count() const { return (uint32_t)parent.size(); }
+
+    // Appends a node under parent (-1 = root) and returns its dense index.
+    // Appending in depth-first order (as the loaders do) keeps the ranges valid
+    // as we go; anything else is sorted out by Finalize().
+    uint32_t Add(const std::string& nodeName, int32_t parentIndex) {
+        uint32_t i = Count();
+        posX.push_back(0); posY.push_back(0); posZ.push_back(0);
+        rotX.push_back(0); rotY.push_back(0); rotZ.push_back(0);
+        sclX.push_back(1); sclY.push_back(1); sclZ.push_back(1);
+        parent.push_back(parentIndex);
+        subtreeEnd.push_back(i + 1);
+        world.push_back(Matrix4());
+        dirty.push_back(1);
+        childDirty.push_back(0);
+        spinning.push_back(0);
+        spinSpeed.push_back(0.0f);
+        model.push_back(nullptr);
+        lod.push_back(0);
+        name.push_back(nodeName);
+
+        if (parentIndex >= 0) {
+            if (subtreeEnd[parentIndex] != i) needsReorder = true; // Parent's range is already closed
+            for (int32_t p = parentIndex; p >= 0 && !needsReorder; p = parent[p]) subtreeEnd[p] = i + 1;
+            for (int32_t p = parentIndex; p >= 0 && !childDirty[p]; p = parent[p]) childDirty[p] = 1;
+        }
+
+        uint32_t slot;
+        if (!freeSlots.empty()) { slot = freeSlots.back(); freeSlots.pop_back(); }
+        else { slot = slotIndex.size(); slotIndex.push_back(0); slotGeneration.push_back(0); }
+        slotIndex[slot] = i;
+        indexSlot.push_back(slot);
+        return i;
+    }
+
+    ObjectHandle HandleOf(uint32_t index) const {
+        ObjectHandle h;
+        h.slot = indexSlot[index];
+        h.generation = slotGeneration[h.slot];
+        return h;
+    }
+
+    int32_t IndexOf(ObjectHandle h) const {
+        if (h.slot >= slotIndex.size() || slotGeneration[h.slot] != h.generation) return -1;
+        return slotIndex[h.slot];
+    }
+
+    // Restores depth-first order after out-of-order Add() calls
+    void Finalize() {
+        if (!needsReorder) return;
+        needsReorder = false;
+
+        uint32_t n = Count();
+        std::vector<std::vector<uint32_t>> children(n);
+        std::vector<uint32_t> stack;
+        for (uint32_t i = n; i-- > 0;) {
+            if (parent[i] >= 0) children[parent[i]].push_back(i);
+            else stack.push_back(i);
+        }
+
+        // order[newIndex] = oldIndex
+        std::vector<uint32_t> order;
+        order.reserve(n);
+        while (!stack.empty()) {
+            uint32_t i = stack.back();
+            stack.pop_back();
+            order.push_back(i);
+            stack.insert(stack.end(), children[i].begin(), children[i].end()); // Stored reversed
+        }
+
+        std::vector<int32_t> newIndex(n);
+        for (uint32_t i = 0; i < n; i++) newIndex[order[i]] = i;
+
+        Permute(posX, order); Permute(posY, order); Permute(posZ, order);
+        Permute(rotX, order); Permute(rotY, order); Permute(rotZ, order);
+        Permute(sclX, order); Permute(sclY, order); Permute(sclZ, order);
+        Permute(parent, order);
+        Permute(world, order);
+        Permute(dirty, order);
+        Permute(childDirty, order);
+        Permute(spinning, order);
+        Permute(spinSpeed, order);
+        Permute(model, order);
+        Permute(lod, order);
+        Permute(name, order);
+        Permute(indexSlot, order);
+        for (uint32_t i = 0; i < n; i++) {
+            if (parent[i] >= 0) parent[i] = newIndex[parent[i]];
+            slotIndex[indexSlot[i]] = i;
+        }
+
+        // In depth-first order each child's range nests inside its parent's
+        for (uint32_t i = 0; i < n; i++) subtreeEnd[i] = i + 1;
+        for (uint32_t i = n; i-- > 0;) {
+            if (parent[i] >= 0) subtreeEnd[parent[i]] = std::max(subtreeEnd[parent[i]], subtreeEnd[i]);
+        }
+        for (uint32_t i = 0; i < n; i++) dirty[i] = 1;
+    }
+
+    // Drops every node; outstanding handles go stale
+    void Clear() {
+        for (uint32_t slot : indexSlot) {
+            slotGeneration[slot]++;
+            freeSlots.push_back(slot);
+        }
+        posX.clear(); posY.clear(); posZ.clear();
+        rotX.clear(); rotY.clear(); rotZ.clear();
+        sclX.clear(); sclY.clear(); sclZ.clear();
+        parent.clear(); subtreeEnd.clear();
+        world.clear(); dirty.clear(); childDirty.clear();
+        spinning.clear(); spinSpeed.clear();
+        model.clear(); lod.clear(); name.clear();
+        indexSlot.clear();
+        needsReorder = false;
+    }
+
+private:
+    template <typename T>
+    static void Permute(std::vector<T>& v, const std::vector<uint32_t>& order) {
+        std::vector<T> out;
+        out.reserve(v.size());
+        for (uint32_t i : order) out.push_back(std::move(v[i]));
+        v.swap(out);
+    }
+
+    // Handle slots: slotIndex[slot] = dense index, indexSlot[index] = slot
+    std::vector<uint32_t> slotIndex;
+    std::vector<uint32_t> slotGeneration;
+    std::vector<uint32_t> indexSlot;
+    std::vector<uint32_t> freeSlots;
+    bool needsReorder = false;
+};
+
+// Point light attached to a scene node (the node's "light" block in the scene file).
+// Follows the node's world position; the node itself can be anything (mesh or group).
+struct SceneLight {
+    ObjectHandle node;
+    float color[4] = {1, 1, 1, 1};      // Diffuse
+    float offset[3] = {0, 0, 0};        // World-space offset from the node's origin
+    float attenuation[3] = {1, 0, 0};   // Constant, linear, quadratic
+    float position[4] = {0, 0, 0, 1};   // World space, refreshed by UpdateLights()
+};
+
+// Per-instance data streamed to Model::instanceVBO every frame
+struct InstanceData {
+    float model[16];    // Column-major world matrix
+    float color[4];
+};
+
+// One visible object, recorded off the GL thread by BuildDrawList()
+struct DrawCommand {
+    uint64_t key;           // MakeDrawKey(): shader, texture, mesh, LOD, material (most expensive change first)
+    Model* model;
+    uint32_t lod;           // Index into model->lods (0 for non-indexed meshes)
+    InstanceData instance;
+};
+
+// GL state traffic of the last frame (B prints it)
+struct RenderStats {
+    int drawCalls = 0;
+    int triangles = 0;
+    int textureBinds = 0;       // glBindTexture calls issued
+    int meshBinds = 0;          // glBindVertexArray calls issued
+    int stateChanges = 0;       // Enable/disable, program, uniform and color changes issued
+    int skippedBinds = 0;       // Binds or changes dropped because that state was already current
+    int occluded = 0;           // Frustum-visible objects skipped by their last occlusion query
+    int occlusionQueries = 0;   // Box queries issued after the draw
+};
+
+// Stable reference to a pooled asset; goes stale (Pool::Get() -> nullptr) once it is destroyed
+struct PoolHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+// Fixed-size chunks of T that never move, so a T* stays valid until Destroy().
+// Freed slots are reused (most recent first) before another chunk is allocated,
+// so loading and unloading scenes keeps cycling through the same memory instead
+// of scattering small blocks across the heap. GLUT thread only.
+template <typename T>
+class Pool {
+public:
+    static const uint32_t CHUNK_SIZE = 64;
+
+    T* Create() {
+        if (freeSlots.empty()) Grow();
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        Slot& s = SlotAt(slot);
+        s.live = true;
+        live++;
+        return new (s.storage) T();
+    }
+
+    void Destroy(T* object) {
+        Slot& s = *reinterpret_cast<Slot*>(object); // storage is the first member
+        object->~T();
+        s.live = false;
+        s.generation++;
+        freeSlots.push_back(s.index);
+        live--;
+    }
+
+    PoolHandle HandleOf(const T* object) const {
+        const Slot& s = *reinterpret_cast<const Slot*>(object);
+        PoolHandle h;
+        h.slot = s.index;
+        h.generation = s.generation;
+        return h;
+    }
+
+    T* Get(PoolHandle h) const {
+        if (h.slot >= chunks.size() * CHUNK_SIZE) return nullptr;
+        Slot& s = SlotAt(h.slot);
+        return s.live && s.generation == h.generation ? reinterpret_cast<T*>(s.storage) : nullptr;
+    }
+
+    size_t Live() const { return live; }
+    size_t Capacity() const { return chunks.size() * CHUNK_SIZE; }
+
+    ~Pool() {
+        for (uint32_t slot = 0; slot < Capacity(); slot++) {
+            Slot& s = SlotAt(slot);
+            if (s.live) reinterpret_cast<T*>(s.storage)->~T();
+        }
+    }
+
+private:
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        uint32_t index = 0;
+        uint32_t generation = 0;
+        bool live = false;
+    };
 
-    Model* model = nullptr;
+    Slot& SlotAt(uint32_t slot) const { return chunks[slot / CHUNK_SIZE][slot % CHUNK_SIZE]; }
+
+    void Grow() {
+        uint32_t first = chunks.size() * CHUNK_SIZE;
+        chunks.emplace_back(new Slot[CHUNK_SIZE]);
+        for (uint32_t k = CHUNK_SIZE; k-- > 0;) {  // Lowest slot on top of the free list
+            chunks.back()[k].index = first + k;
+            freeSlots.push_back(first + k);
+        }
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> chunks;
+    std::vector<uint32_t> freeSlots;
+    size_t live = 0;
+};
+
+// Hashed, reference-counted lookup of loaded assets by path; the assets themselves
+// live in the registry's pool. GLUT thread only.
+template <typename T>
+class AssetRegistry {
+public:
+    // Adds a reference to an already registered asset, or returns nullptr
+    T* Acquire(const std::string& path) {
+        auto it = entries.find(path);
+        if (it == entries.end()) return nullptr;
+        it->second.refCount++;
+        return pool.Get(it->second.handle);
+    }
+
+    // Allocates and registers a new asset holding one reference
+    T* Create(const std::string& path) {
+        T* asset = pool.Create();
+        entries[path] = Entry{pool.HandleOf(asset), 1};
+        return asset;
+    }
+
+    // Drops a reference. Returns true when it was the last one (entry is removed;
+    // the caller frees its resources, then Destroy()s it)
+    bool Release(const std::string& path) {
+        auto it = entries.find(path);
+        if (it == entries.end()) return false;
+        if (--it->second.refCount > 0) return false;
+        entries.erase(it);
+        return true;
+    }
+
+    void Destroy(T* asset) { pool.Destroy(asset); }
+
+    PoolHandle HandleOf(const T* asset) const { return pool.HandleOf(asset); }
+    T* Get(PoolHandle h) const { return pool.Get(h); }
+
+    // Calls fn(T*) for every registered asset
+    template <typename F>
+    void ForEach(F fn) const {
+        for (const auto& e : entries) {
+            if (T* asset = pool.Get(e.second.handle)) fn(asset);
+        }
+    }
+
+    size_t Size() const { return entries.size(); }
+    size_t Live() const { return pool.Live(); }     // Also counts released assets whose load is still in flight
+
+private:
+    struct Entry {
+        PoolHandle handle;
+        int refCount;
+    };
+    std::unordered_map<std::string, Entry> entries;
+    Pool<T> pool;
 };
 
 // ==========================================
 // 2. GLOBALS
 // ==========================================
-std::vector<Object*> sceneObjects;  
-std::vector<Model*> loadedModels;   
+SceneStore scene;                   // Every node, depth-first (see SceneStore)
+AssetRegistry<Model> modelRegistry;
+AssetRegistry<Texture> textureRegistry;
 
-Object* selectedObject = nullptr;
+ObjectHandle selectedObject;        // Stale handle (IndexOf() < 0) = nothing selected
 int selectionIndex = 0;
 
 // Camera (Orbit)
 float cameraAngle = 0.0f;   
 float cameraHeight = 5.0f;  
 float cameraDist = 15.0f;   
+const double CAMERA_FOV_Y = 45.0;   // Degrees (gluPerspective in reshape)
 
 bool isClockAnimating = true;
 bool isRoomSpinning = false; // NEW: Controls the 360 view
 
+// Timing: animation runs on elapsed seconds; idle() unregisters itself when nothing moves
+const float CLOCK_SPIN_SPEED = 60.0f;   // Degrees per second (was 1 degree per idle call)
+const float ROOM_SPIN_SPEED = 0.3f;     // Radians per second (was 0.005 per idle call)
+const float HIGHLIGHT_PULSE_SECONDS = 3.0f; // Selection pulses this long, then holds steady
+const float MAX_TIMESTEP = 0.1f;        // Clamp so a stall doesn't teleport animations
+int frameCap = 60;                      // Max animated frames per second (0 = uncapped)
+bool useVSync = false;
+double lastUpdateTime = 0.0;
+double lastFrameTime = 0.0;
+double selectionTime = 0.0;             // When the current selection was made
+bool idleRegistered = false;
+FILE* cameraRecordFile = nullptr;       // --record-path: display() appends the camera each frame
+double cameraRecordStart = 0.0;
+
+// Loader: share identical (pos, normal, uv) corners through an index buffer
+bool useIndexedMeshes = true;
+const int VERTEX_CACHE_SIZE = 16; // Post-transform cache size assumed by Tipsify
+
+// Loader: meshes without normals get smooth ones, each face weighted by its area or
+// by its corner angle (less skewed by uneven tessellation); UV'd meshes get tangents
+enum NormalWeighting { NORMALS_AREA, NORMALS_ANGLE };
+NormalWeighting normalWeighting = NORMALS_ANGLE;    // Part of the mesh cache key
+const uint32_t NORMAL_JOB_GRAIN = 16384;            // Triangles / vertices per job chunk
+
+// Instanced rendering (objects sharing a Model are drawn with one call)
+bool useInstancing = true;
+bool instancingSupported = false;   // Set by init(): GL 3.3 + shader compiled
+GLuint instancedProgram = 0;
+const GLuint ATTR_INSTANCE_MODEL = 10; // mat4 uses 10..13, clear of the built-in aliases
+const GLuint ATTR_INSTANCE_COLOR = 14;
+
+// Frustum culling against the orbit camera
+bool useFrustumCulling = true;
+std::vector<uint32_t> visibleObjects; // Node indices, rebuilt every frame by CullObjects()
+int culledCount = 0;
+std::vector<DrawCommand> drawList;    // Sorted commands for visibleObjects (BuildDrawList)
+RenderStats renderStats;
+
+// Scene BVH over the world bounds of every loaded mesh node: frustum culling and
+// mouse picking. Rebuilt when the set of objects changes, refit when they move.
+Bvh sceneBvh;
+std::vector<uint32_t> sceneBvhNodes;  // BVH item -> node index
+std::vector<int32_t> nodeBvhItem;     // Node index -> BVH item, -1 = not in the tree
+bool sceneBvhDirty = true;            // Rebuild before the next query
+float sceneBvhBuildArea = 0.0f;       // Root area at the last build
+const float BVH_REBUILD_GROWTH = 2.0f;  // Refits that grow the root past this factor trigger a rebuild
+bool useBvhCulling = true;            // Off = linear scan over the scene
+bool usePickTriangles = true;         // Exact picking through each mesh's triangle BVH (off = bounds only)
+
+// Hardware occlusion culling (X) after frustum culling, with temporal coherence:
+// objects keep their last result. The world box of an object is drawn into the
+// frame's finished depth buffer inside a query, so one hidden by the room shell or
+// large furniture is skipped until its box shows again (see CullOccluded()).
+// Results are only read once available, a frame or more later, so the CPU never
+// waits on the GPU; an object coming out from behind a wall pops in a frame late.
+struct OcclusionState {
+    GLuint query = 0;
+    bool pending = false;       // Issued, result not read yet
+    bool occluded = false;      // Last result read: no sample of the box passed
+    uint32_t lastSeen = 0;      // occlusionFrame it was last inside the frustum
+};
+bool useOcclusionCulling = true;
+bool occlusionSupported = false;      // Set by init(): GL 3.0 (queries + the box VAO)
+GLenum occlusionTarget = GL_SAMPLES_PASSED;  // GL_ANY_SAMPLES_PASSED where GL 3.3 has it
+std::vector<OcclusionState> occlusion;       // Per node index, reset when the scene loads
+std::vector<uint32_t> occlusionTests;        // Drawn nodes re-tested this frame (read in a later one)
+std::vector<uint32_t> occlusionHidden;       // Skipped this frame: re-tested against its depth
+uint32_t occlusionFrame = 0;
+GLuint occlusionBoxVao = 0, occlusionBoxVbo = 0;
+const uint32_t OCCLUSION_VISIBLE_INTERVAL = 4; // Visible objects re-test every Nth frame, staggered
+const float OCCLUSION_BOX_MARGIN = 0.02f;     // Relative growth, so a box never hides behind its own surface
+const float OCCLUSION_NEAR_MARGIN = 0.25f;    // Eye this close to a box: near plane may clip it, always draw
+
+// Static batching (Z): small meshes that never move (no spin on them or above them)
+// are pre-transformed into world space and merged per texture into shared buffers,
+// drawn like one object with an identity transform. Editing or selecting a node
+// pulls its subtree out (an index rewrite); once it has been left alone for
+// STATIC_SETTLE_SECONDS it rejoins and only that batch is rebuilt.
+struct StaticBatch {
+    Model mesh;                         // Merged world-space geometry; LOD 0 = the members drawn now
+    std::vector<uint32_t> members;      // Node indices with geometry in mesh
+    std::vector<uint32_t> memberIndices;    // Start of each member's range in indices (+ end)
+    std::vector<unsigned int> indices;  // Every member's triangles, drawn or not
+    bool needsRebuild = false;          // A pulled-out node is ready to rejoin
+};
+bool useStaticBatching = true;
+std::vector<StaticBatch*> staticBatches;
+std::vector<int32_t> nodeBatch;         // Node -> batch drawing it, -1 = drawn on its own
+int batchedNodeCount = 0;               // Nodes with nodeBatch >= 0
+std::vector<uint32_t> pulledNodes;      // Out of their batch for now, waiting to rejoin
+std::vector<double> nodeEditTime;       // Last edit, for STATIC_SETTLE_SECONDS
+std::vector<uint32_t> visibleBatches;   // Filled by CullObjects()
+bool staticBatchesDirty = true;         // Rebuild all of them once loading is done
+const size_t STATIC_BATCH_MAX_VERTICES = 65536;  // Per batch: bounds culling and rebuilds stay local
+const size_t STATIC_OBJECT_MAX_VERTICES = 4096;  // Bigger meshes keep their own draw (and LODs)
+const float STATIC_SETTLE_SECONDS = 1.0f;
+
+// Scene lights, resolved at load. Uploads happen only when lightsVersion moves on
+// (a light was added/removed or its world position changed), or, for the
+// fixed-function path, when the view changes (GL_POSITION is stored in eye space).
+std::vector<SceneLight> sceneLights;
+uint32_t lightsVersion = 1;
+const int MAX_SHADER_LIGHTS = 32;   // Array size in INSTANCED_VS
+GLint maxFixedLights = 8;           // GL_MAX_LIGHTS (init); GL_LIGHT0 stays the room light
+
+// Clustered forward lighting (instanced draws only): scene lights are binned into a
+// view-space grid (screen tiles x exponential depth slices) and each fragment only
+// loops over its cluster's lights. Off / unsupported -> per-vertex shader lights.
+bool useClusteredLighting = true;
+bool clusteredSupported = false;    // Set by init(): GL 3.3 + shader compiled
+GLuint clusteredProgram = 0;
+const int CLUSTER_X = 16, CLUSTER_Y = 9, CLUSTER_Z = 24;   // Also in CLUSTERED_FS
+const int MAX_CLUSTERED_LIGHTS = 1024;
+const int LIGHT_INDEX_TEX_WIDTH = 1024;                     // Also in CLUSTERED_FS
+const float LIGHT_CUTOFF = 1.0f / 256.0f;   // Light range ends where its contribution drops below this
+GLuint clusterGridTex = 0, lightIndexTex = 0, lightDataTex = 0;
+int clusterLightRefs = 0;           // Light-in-cluster entries of the last binning (L prints it)
+int windowWidth = 1024, windowHeight = 768;
+
+// Profiler (HUD on P, Chrome trace on Ctrl+P) and the memory it reports
+bool showProfilerHud = false;
+size_t gpuBufferBytes = 0;          // Static vertex + index buffers
+size_t gpuTextureBytes = 0;         // Estimated from format, size and mips
+
+// Binary mesh cache written next to each .obj / .off (bump the version when the layout changes)
+bool useMeshCache = true;
+const uint32_t MESH_CACHE_VERSION = 3;
+
+// Hot reload: a watcher thread polls every file the loaded assets came from (OBJ /
+// OFF, MTL, texture or its KTX) and re-imports just the ones that changed, in place
+bool useHotReload = true;                   // --no-hot-reload turns it off
+const double HOT_RELOAD_POLL_SECONDS = 0.5; // Watcher stat() interval; a change must hold for one more poll
+const int HOT_RELOAD_WAKE_MS = 100;         // GLUT timer that wakes idle() for a posted reload
+
+// Mesh LODs: simplified index ranges built at import (quadric error metrics), picked
+// per object by how many pixels their error covers at the object's distance
+bool useMeshLods = true;
+const int MAX_MESH_LODS = 4;                // Full mesh + up to 3 simplified levels
+const uint32_t LOD_MIN_TRIANGLES = 64;      // Smaller meshes / levels aren't simplified further
+const float LOD_PIXEL_ERROR = 1.0f;         // Allowed on-screen deviation
+const float LOD_HYSTERESIS = 0.25f;         // A coarser LOD must beat the limit by this fraction
+float lodPixelScale = 1.0f;                 // Pixels per unit of size at distance 1 (reshape)
+
+// Batch transform kernel (SIMD); off = scalar reference path
+bool useSimdTransforms = true;
+
 // ==========================================
-// 3. TEXTURE LOADING
+// 3. ASYNC LOADER
 // ==========================================
-GLuint LoadTextureFromFile(const char* filename) {
-    // UPDATED: User requested path "models/textures/"
-    std::string fullPath = "models/textures/" + std::string(filename);
-    
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load(fullPath.c_str(), &width, &height, &nrChannels, 0);
-    
-    if (!data) {
-        std::cout << "Failed to load texture: " << fullPath << " (using white fallback)" << std::endl;
-        return 0;
+// Worker threads do file I/O + parsing + decoding; anything touching GL is
+// posted back to the upload queue, which the GLUT thread drains in idle().
+void NameProfilerThread(const std::string& name); // Profiler (below)
+
+class LoaderPool {
+public:
+    void Start(unsigned int numThreads) {
+        if (numThreads == 0) numThreads = 1;
+        for (unsigned int i = 0; i < numThreads; i++) {
+            workers.emplace_back([this, i] {
+                NameProfilerThread("Loader " + std::to_string(i + 1));
+                WorkerLoop();
+            });
+        }
     }
 
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    void Submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_one();
+    }
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    ~LoaderPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& t : workers) t.join();
+    }
 
-    int format = (nrChannels == 4) ? GL_RGBA : GL_RGB;
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-    
-    stbi_image_free(data);
-    return textureID;
+private:
+    void WorkerLoop() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+};
+
+std::mutex uploadMutex;
+std::vector<std::function<void()>> uploadQueue; // GL work, run on the GLUT thread
+std::atomic<int> pendingAssets(0);
+std::atomic<int> pendingReloads(0);             // Hot reloads in flight (not part of a scene load)
+std::chrono::steady_clock::time_point loadStartTime;
+
+// Declared after the queue so it is destroyed (and its threads joined) first
+LoaderPool loaderPool;
+bool useAsyncLoading = true;
+
+void PostToMainThread(std::function<void()> fn) {
+    std::lock_guard<std::mutex> lock(uploadMutex);
+    uploadQueue.push_back(std::move(fn));
 }
 
-// ==========================================
-// 4. MODEL LOADING
-// ==========================================
-Model* GetModel(std::string filename) {
-    for (auto* m : loadedModels) {
-        if (m->name == filename) return m;
+// Runs queued GL uploads. Returns true if anything was uploaded.
+bool PumpUploadQueue() {
+    std::vector<std::function<void()>> work;
+    {
+        std::lock_guard<std::mutex> lock(uploadMutex);
+        work.swap(uploadQueue);
     }
+    for (auto& fn : work) fn();
+    return !work.empty();
+}
 
-    std::cout << "Loading Model: " << filename << "... ";
-    Model* m = new Model();
-    m->name = filename;
+double NowSeconds() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
 
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+void WakeIdle(); // GLUT section
 
-    // Load OBJ from "models/" folder
-    std::string fullPath = "models/" + filename;
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, fullPath.c_str(), "models/");
+// Single write per message so worker output doesn't interleave
+void LogLine(const std::string& line) {
+    static std::mutex logMutex;
+    std::lock_guard<std::mutex> lock(logMutex);
+    std::cout << line << std::endl;
+}
 
-    if (!warn.empty()) std::cout << "WARN: " << warn << std::endl;
-    if (!ret) {
-        std::cout << "FAILED! " << err << std::endl;
-        delete m;
-        return nullptr;
+// ------------------------------------------
+// Frame job system
+// ------------------------------------------
+// Data-parallel passes of a frame (animation, transforms, culling, draw list).
+// Each worker owns a deque: it pops its own newest job and, when empty, steals
+// the oldest job of another worker. The calling (GLUT) thread works too, so a
+// pool started with 0 workers simply runs everything inline.
+class JobSystem {
+public:
+    typedef std::function<void(uint32_t, uint32_t)> RangeFn;
+
+    void Start(unsigned int numWorkers) {
+        for (unsigned int i = 0; i <= numWorkers; i++) queues.emplace_back(new Queue()); // Last = caller
+        for (unsigned int i = 0; i < numWorkers; i++) {
+            workers.emplace_back([this, i] { WorkerLoop(i); });
+        }
     }
 
-    // Load Texture from MTL if available
-    if (!materials.empty() && !materials[0].diffuse_texname.empty()) {
-        std::string rawName = materials[0].diffuse_texname;
-        size_t lastSlash = rawName.find_last_of("/\\");
-        std::string fileName = (lastSlash == std::string::npos) ? rawName : rawName.substr(lastSlash + 1);
+    unsigned int ThreadCount() const { return workers.size() + 1; }
+
+    // Calls fn(begin, end) over [0, count) in chunks of about `grain` items and
+    // returns once every chunk has run. Chunks must not write shared state.
+    void ParallelFor(uint32_t count, uint32_t grain, const RangeFn& fn) {
+        if (count == 0) return;
+        uint32_t chunks = (count + grain - 1) / grain;
+        if (workers.empty() || chunks < 2) {
+            for (uint32_t c = 0; c < chunks; c++) fn(c * grain, std::min(count, (c + 1) * grain));
+            return;
+        }
+
+        std::atomic<uint32_t> remaining(chunks);
+        for (uint32_t c = 0; c < chunks; c++) {
+            Job job = { &fn, c * grain, std::min(count, (c + 1) * grain), &remaining };
+            Queue& q = *queues[c % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.jobs.push_back(job);
+        }
+        queuedJobs += chunks;
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex); // A worker between its check and wait() can't miss this
+        }
+        wakeCv.notify_all();
 
-        std::cout << "[Texture: " << fileName << "] ";
-        m->textureID = LoadTextureFromFile(fileName.c_str());
+        // Help out until our chunks are done (later chunks may still be running elsewhere)
+        unsigned int self = queues.size() - 1;
+        while (remaining > 0) {
+            Job job;
+            if (Pop(self, job)) Run(job);
+            else std::this_thread::yield();
+        }
     }
 
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            m->vertices.push_back(attrib.vertices[3 * index.vertex_index + 0]);
-            m->vertices.push_back(attrib.vertices[3 * index.vertex_index + 1]);
-            m->vertices.push_back(attrib.vertices[3 * index.vertex_index + 2]);
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wakeCv.notify_all();
+        for (auto& t : workers) t.join();
+    }
 
-            if (index.normal_index >= 0) {
-                m->normals.push_back(attrib.normals[3 * index.normal_index + 0]);
-                m->normals.push_back(attrib.normals[3 * index.normal_index + 1]);
-                m->normals.push_back(attrib.normals[3 * index.normal_index + 2]);
-            }
+private:
+    struct Job {
+        const RangeFn* fn;
+        uint32_t begin, end;
+        std::atomic<uint32_t>* remaining;
+    };
 
-            if (index.texcoord_index >= 0) {
-                m->texcoords.push_back(attrib.texcoords[2 * index.texcoord_index + 0]);
-                m->texcoords.push_back(attrib.texcoords[2 * index.texcoord_index + 1]);
-            }
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    bool Pop(unsigned int self, Job& out) {
+        for (size_t k = 0; k < queues.size(); k++) {
+            Queue& q = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.jobs.empty()) continue;
+            if (k == 0) { out = q.jobs.back(); q.jobs.pop_back(); }   // Own queue: newest first
+            else { out = q.jobs.front(); q.jobs.pop_front(); }        // Steal: oldest first
+            queuedJobs--;
+            return true;
         }
+        return false;
     }
 
-    m->loaded = true;
-    std::cout << "Done. (" << m->vertices.size()/3 << " tris)" << std::endl;
-    loadedModels.push_back(m);
-    return m;
+    static void Run(const Job& job) {
+        (*job.fn)(job.begin, job.end);
+        job.remaining->fetch_sub(1);
+    }
+
+    void WorkerLoop(unsigned int self) {
+        for (;;) {
+            Job job;
+            if (Pop(self, job)) { Run(job); continue; }
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wakeCv.wait(lock, [this] { return stopping || queuedJobs > 0; });
+            if (stopping) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queuedJobs{0};
+    std::mutex wakeMutex;
+    std::condition_variable wakeCv;
+    bool stopping = false;
+};
+
+JobSystem frameJobs;
+const uint32_t FRAME_JOB_GRAIN = 1024; // Nodes per chunk; smaller scenes run inline
+
+// Import work fanned out by the loader threads. Kept apart from frameJobs, whose
+// callers all help through one queue: the GLUT thread would pick up import chunks
+// mid-frame, and the frame workers would sit behind them.
+JobSystem importJobs;
+
+// ------------------------------------------
+// File watcher (hot reload)
+// ------------------------------------------
+// Polls the source files of the loaded assets with stat() on its own thread and
+// reports the ones whose size or mtime moved. A change is only reported once the
+// file has looked the same for two polls in a row, so an editor or exporter that
+// writes in several steps triggers one reload, after it has finished.
+struct FileStamp {
+    int64_t size = -1;      // -1 = missing
+    int64_t mtimeNs = 0;
+
+    bool operator==(const FileStamp& o) const { return size == o.size && mtimeNs == o.mtimeNs; }
+    bool operator!=(const FileStamp& o) const { return !(*this == o); }
+};
+
+FileStamp StatFile(const std::string& path) {
+    FileStamp f;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return f;
+    f.size = st.st_size;
+    f.mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return f;
 }
 
-// ==========================================
-// 5. SCENE SETUP
-// ==========================================
-void AddObj(std::string name, std::string modelName, 
-            float x, float y, float z, 
-            float rx, float ry, float rz, 
-            float sx, float sy, float sz,
-            bool isAnimated = false) 
-{
-    Object* obj = new Object();
-    obj->name = name;
-    obj->model = GetModel(modelName); 
-    
-    obj->x = x; obj->y = y; obj->z = z;
-    obj->rx = rx; obj->ry = ry; obj->rz = rz;
-    obj->sx = sx; obj->sy = sy; obj->sz = sz;
+class FileWatcher {
+public:
+    // onChange(path) runs on the watcher thread
+    void Start(std::function<void(const std::string&)> callback) {
+        onChange = std::move(callback);
+        thread = std::thread([this] {
+            NameProfilerThread("File watcher");
+            Loop();
+        });
+    }
+
+    bool Running() const { return thread.joinable(); }
+
+    // Reference counted (assets share MTLs and textures). A missing file is watched
+    // for appearing. No-op until Start().
+    void Watch(const std::string& path) {
+        if (!Running() || path.empty()) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry& e = entries[path];
+        if (e.refs++ == 0) e.stamp = e.candidate = StatFile(path);
+    }
+
+    void Unwatch(const std::string& path) {
+        if (!Running() || path.empty()) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        if (it != entries.end() && --it->second.refs == 0) entries.erase(it);
+    }
+
+    ~FileWatcher() {
+        if (!Running()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        thread.join();
+    }
+
+private:
+    struct Entry {
+        FileStamp stamp;        // Last reported (or first seen) state
+        FileStamp candidate;    // Seen on the last poll
+        int refs = 0;
+    };
+
+    void Loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::chrono::duration<double> interval(HOT_RELOAD_POLL_SECONDS);
+        while (!cv.wait_for(lock, interval, [this] { return stopping; })) {
+            // stat() outside the lock so Watch() from the GLUT thread never waits on the disk
+            std::vector<std::string> paths;
+            for (const auto& e : entries) paths.push_back(e.first);
+            lock.unlock();
+            std::vector<FileStamp> stamps;
+            for (const std::string& p : paths) stamps.push_back(StatFile(p));
+            lock.lock();
+
+            std::vector<std::string> changed;
+            for (size_t k = 0; k < paths.size(); k++) {
+                auto it = entries.find(paths[k]);
+                if (it == entries.end()) continue;  // Unwatched meanwhile
+                Entry& e = it->second;
+                if (stamps[k] != e.candidate) { e.candidate = stamps[k]; continue; }  // Still being written
+                if (stamps[k] == e.stamp) continue;
+                e.stamp = stamps[k];
+                if (stamps[k].size >= 0) changed.push_back(paths[k]);  // Deleted: keep what is loaded
+            }
+
+            lock.unlock();
+            for (const std::string& p : changed) onChange(p);
+            lock.lock();
+        }
+    }
+
+    std::unordered_map<std::string, Entry> entries;
+    std::function<void(const std::string&)> onChange;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread thread;
+};
+
+// Declared after the upload queue it posts to, so its thread is joined first
+FileWatcher fileWatcher;
+std::atomic<bool> hotReloadPosted(false); // Set with each posted change; HotReloadTimer wakes idle()
+
+// ------------------------------------------
+// Frame profiler
+// ------------------------------------------
+// CPU scopes (any thread) land in one event buffer that Ctrl+P writes out as a
+// Chrome trace (chrome://tracing, Perfetto). Scopes on the GLUT thread also feed
+// the per-frame numbers of the HUD (P). GPU scopes are GL_TIMESTAMP query pairs,
+// read back a few frames later so the CPU never waits on them.
+struct ProfileEvent {
+    const char* name;
+    std::string detail;     // Asset path for load events
+    double begin, end;      // NowSeconds()
+    int thread;             // -1 = GPU
+    bool load;              // Load phase (kept until the next scene load)
+};
+
+// Smoothed per-frame time of one named scope
+struct ProfileStat {
+    const char* name;
+    float frameMs;          // Sum over the frame in progress
+    float avgMs;
+};
+
+// s as a quoted JSON string (the trace and the benchmark results)
+void WriteJsonString(FILE* f, const std::string& s) {
+    fputc('"', f);
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') { fputc('\\', f); fputc(c, f); }
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+// Render counters of one frame, for the trace's counter tracks
+struct ProfileFrame {
+    double time;
+    RenderStats stats;
+    int visible;
+    size_t gpuBytes;
+};
+
+class Profiler {
+public:
+    // The first thread to record (main(): before the loaders start) is the GLUT thread
+    int ThreadIndex() {
+        thread_local int index = -1;
+        if (index < 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            index = threadNames.size();
+            threadNames.push_back(index == 0 ? "GLUT" : "Thread " + std::to_string(index));
+        }
+        return index;
+    }
+
+    void NameThread(const std::string& name) {
+        int index = ThreadIndex();
+        std::lock_guard<std::mutex> lock(mutex);
+        threadNames[index] = name;
+    }
+
+    // Thread-safe. Frame events roll over after PROFILE_MAX_EVENTS.
+    void Record(const char* name, std::string detail, double begin, double end, bool load) {
+        int thread = ThreadIndex();
+        if (thread == 0 && !load) AddTime(cpuStats, name, (end - begin) * 1000.0);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (load) loadEvents.push_back({ name, std::move(detail), begin, end, thread, true });
+        else {
+            events.push_back({ name, std::move(detail), begin, end, thread, false });
+            if (events.size() > PROFILE_MAX_EVENTS) events.pop_front();
+        }
+    }
+
+    void ClearLoads() {
+        std::lock_guard<std::mutex> lock(mutex);
+        loadEvents.clear();
+    }
+
+    void EnableGpuTimers(bool on) { gpuTimers = on; }
+
+    // GLUT thread, around display()
+    void BeginFrame() {
+        frameStart = NowSeconds();
+        if (!gpuTimers) return;
+        GpuFrame& f = gpuFrames[frame % GPU_FRAME_LAG];
+        CollectGpu(f);
+        f.cpuStart = frameStart;
+        f.startQuery = AcquireQuery();
+        glQueryCounter(f.startQuery, GL_TIMESTAMP);
+    }
+
+    void EndFrame(const RenderStats& stats, int visible, size_t gpuBytes) {
+        double now = NowSeconds();
+        if (lastFrameEnd > 0.0) frameMs = frameMs * (1.0f - SMOOTHING) + (float)((now - lastFrameEnd) * 1000.0) * SMOOTHING;
+        lastFrameEnd = now;
+        cpuFrameMs = cpuFrameMs * (1.0f - SMOOTHING) + (float)((now - frameStart) * 1000.0) * SMOOTHING;
+        Smooth(cpuStats);
+        frame++;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        frames.push_back({ now, stats, visible, gpuBytes });
+        if (frames.size() > PROFILE_MAX_FRAMES) frames.pop_front();
+    }
+
+    // Timestamp pair around GL work (nests freely, unlike GL_TIME_ELAPSED)
+    void GpuBegin(const char* name) {
+        if (!gpuTimers) return;
+        GpuFrame& f = gpuFrames[frame % GPU_FRAME_LAG];
+        f.timings.push_back({ name, AcquireQuery(), 0 });
+        glQueryCounter(f.timings.back().begin, GL_TIMESTAMP);
+        f.open.push_back(f.timings.size() - 1);
+    }
+
+    void GpuEnd() {
+        if (!gpuTimers) return;
+        GpuFrame& f = gpuFrames[frame % GPU_FRAME_LAG];
+        GpuTiming& t = f.timings[f.open.back()];
+        f.open.pop_back();
+        t.end = AcquireQuery();
+        glQueryCounter(t.end, GL_TIMESTAMP);
+    }
+
+    float FrameMs() const { return frameMs; }
+    float CpuFrameMs() const { return cpuFrameMs; }
+    const std::vector<ProfileStat>& CpuStats() const { return cpuStats; }
+    const std::vector<ProfileStat>& GpuStats() const { return gpuStats; }
+    bool GpuTimers() const { return gpuTimers; }
+
+    // Chrome trace event format: complete ("X") events per scope, counter ("C")
+    // events per frame, thread names as metadata
+    bool WriteTrace(const std::string& path) {
+        FILE* f = fopen(path.c_str(), "w");
+        if (!f) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+
+        double origin = INFINITY;
+        for (const ProfileEvent& e : loadEvents) origin = std::min(origin, e.begin);
+        for (const ProfileEvent& e : events) origin = std::min(origin, e.begin);
+        for (const ProfileFrame& fr : frames) origin = std::min(origin, fr.time);
+        if (!std::isfinite(origin)) origin = 0.0;
+
+        fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        auto separator = [&] { fputs(first ? "" : ",\n", f); first = false; };
+        for (size_t t = 0; t < threadNames.size(); t++) {
+            separator();
+            fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":", t);
+            WriteJsonString(f, threadNames[t]);
+            fputs("}}", f);
+        }
+        separator();
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", GPU_TRACK);
+
+        for (const std::deque<ProfileEvent>* list : { &loadEvents, &events }) {
+            for (const ProfileEvent& e : *list) {
+                separator();
+                fputs("{\"name\":", f);
+                WriteJsonString(f, e.name);
+                fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                        e.load ? "load" : e.thread < 0 ? "gpu" : "frame", e.thread < 0 ? GPU_TRACK : e.thread,
+                        (e.begin - origin) * 1e6, (e.end - e.begin) * 1e6);
+                if (!e.detail.empty()) {
+                    fputs(",\"args\":{\"asset\":", f);
+                    WriteJsonString(f, e.detail);
+                    fputc('}', f);
+                }
+                fputc('}', f);
+            }
+        }
+
+        for (const ProfileFrame& fr : frames) {
+            double ts = (fr.time - origin) * 1e6;
+            separator();
+            fprintf(f, "{\"name\":\"Draws\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"draw calls\":%d,\"texture binds\":%d,\"mesh binds\":%d,\"state changes\":%d}}",
+                    ts, fr.stats.drawCalls, fr.stats.textureBinds, fr.stats.meshBinds, fr.stats.stateChanges);
+            separator();
+            fprintf(f, "{\"name\":\"Geometry\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"triangles\":%d,\"visible objects\":%d,\"occluded objects\":%d}}",
+                    ts, fr.stats.triangles, fr.visible, fr.stats.occluded);
+            separator();
+            fprintf(f, "{\"name\":\"GPU memory (MB)\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"buffers + textures\":%.2f}}",
+                    ts, fr.gpuBytes / (1024.0 * 1024.0));
+        }
+        fputs("\n]}\n", f);
+        return fclose(f) == 0;
+    }
+
+private:
+    struct GpuTiming {
+        const char* name;
+        GLuint begin, end;
+    };
+    struct GpuFrame {
+        double cpuStart = 0.0;
+        GLuint startQuery = 0;
+        std::vector<GpuTiming> timings;
+        std::vector<size_t> open;   // Unfinished GpuBegin()s
+    };
+
+    static const size_t PROFILE_MAX_EVENTS = 100000;
+    static const size_t PROFILE_MAX_FRAMES = 2000;
+    static const int GPU_FRAME_LAG = 4;         // Frames in flight before a readback
+    static const int GPU_TRACK = 1000;          // Trace thread id of the GPU track
+    static constexpr float SMOOTHING = 0.1f;
+
+    static void AddTime(std::vector<ProfileStat>& stats, const char* name, double ms) {
+        for (ProfileStat& s : stats) {
+            if (strcmp(s.name, name) == 0) { s.frameMs += ms; return; }
+        }
+        stats.push_back({ name, (float)ms, (float)ms });
+    }
+
+    static void Smooth(std::vector<ProfileStat>& stats) {
+        for (ProfileStat& s : stats) {
+            s.avgMs = s.avgMs * (1.0f - SMOOTHING) + s.frameMs * SMOOTHING;
+            s.frameMs = 0.0f;
+        }
+    }
+
+    GLuint AcquireQuery() {
+        if (freeQueries.empty()) {
+            GLuint q[64];
+            glGenQueries(64, q);
+            freeQueries.insert(freeQueries.end(), q, q + 64);
+        }
+        GLuint q = freeQueries.back();
+        freeQueries.pop_back();
+        return q;
+    }
+
+    // Reads back a frame issued GPU_FRAME_LAG frames ago. If the GPU still isn't
+    // done with it, its timings are dropped rather than waited for.
+    void CollectGpu(GpuFrame& f) {
+        if (!f.startQuery) return;
+        GLint ready = 0;
+        glGetQueryObjectiv(f.startQuery, GL_QUERY_RESULT_AVAILABLE, &ready);
+        for (size_t i = 0; i < f.timings.size() && ready && f.open.empty(); i++) {
+            glGetQueryObjectiv(f.timings[i].end, GL_QUERY_RESULT_AVAILABLE, &ready);
+        }
+        if (ready && f.open.empty()) {
+            GLuint64 start;
+            glGetQueryObjectui64v(f.startQuery, GL_QUERY_RESULT, &start);
+            for (const GpuTiming& t : f.timings) {
+                GLuint64 b, e;
+                glGetQueryObjectui64v(t.begin, GL_QUERY_RESULT, &b);
+                glGetQueryObjectui64v(t.end, GL_QUERY_RESULT, &e);
+                AddTime(gpuStats, t.name, (e - b) * 1e-6);
+                // Placed on the CPU clock relative to the frame start
+                double begin = f.cpuStart + (double)(int64_t)(b - start) * 1e-9;
+                double end = f.cpuStart + (double)(int64_t)(e - start) * 1e-9;
+                std::lock_guard<std::mutex> lock(mutex);
+                events.push_back({ t.name, std::string(), begin, end, -1, false });
+                if (events.size() > PROFILE_MAX_EVENTS) events.pop_front();
+            }
+            Smooth(gpuStats);
+        }
+        for (const GpuTiming& t : f.timings) {
+            freeQueries.push_back(t.begin);
+            if (t.end) freeQueries.push_back(t.end);
+        }
+        freeQueries.push_back(f.startQuery);
+        f.startQuery = 0;
+        f.timings.clear();
+        f.open.clear();
+    }
+
+    std::mutex mutex;
+    std::deque<ProfileEvent> events;
+    std::deque<ProfileEvent> loadEvents;
+    std::deque<ProfileFrame> frames;
+    std::vector<std::string> threadNames;
+
+    // GLUT thread only
+    std::vector<ProfileStat> cpuStats, gpuStats;
+    float frameMs = 0.0f, cpuFrameMs = 0.0f;
+    double frameStart = 0.0, lastFrameEnd = 0.0;
+    GpuFrame gpuFrames[GPU_FRAME_LAG];
+    std::vector<GLuint> freeQueries;
+    uint64_t frame = 0;
+    bool gpuTimers = false;
+};
+
+Profiler profiler;
+
+// Times the enclosing block on the calling thread
+struct ProfileScope {
+    const char* name;
+    std::string detail;
+    double begin;
+    bool load;
+
+    explicit ProfileScope(const char* scopeName) : name(scopeName), begin(NowSeconds()), load(false) {}
+    ProfileScope(const char* scopeName, const std::string& asset) : name(scopeName), detail(asset), begin(NowSeconds()), load(true) {}
+    ~ProfileScope() { profiler.Record(name, std::move(detail), begin, NowSeconds(), load); }
+};
+
+// GPU time of the GL commands issued in the enclosing block (GLUT thread)
+struct GpuProfileScope {
+    explicit GpuProfileScope(const char* name) { profiler.GpuBegin(name); }
+    ~GpuProfileScope() { profiler.GpuEnd(); }
+};
+
+void NameProfilerThread(const std::string& name) {
+    profiler.NameThread(name);
+}
+
+// ==========================================
+// 4. TEXTURE LOADING
+// ==========================================
+bool useMipmaps = true;
+bool useCompressedTextures = true;     // Prefer "<name>.ktx" next to the source image
+std::vector<GLint> compressedFormats;  // Filled by init(), read-only afterwards
+
+// Decoded pixels waiting for upload (safe to produce on a worker thread)
+struct TextureData {
+    int width = 0, height = 0, channels = 0;
+    unsigned char* pixels = nullptr;    // stb_image path
+
+    // Precompressed path: raw KTX blocks, one entry per mip level
+    struct Level {
+        int width, height;
+        size_t offset, size;
+    };
+    GLenum internalFormat = 0;
+    std::vector<unsigned char> blob;
+    std::vector<Level> levels;
+};
+
+// KTX 1.1 container holding a single 2D compressed image + mip chain.
+// The GPU can't flip compressed blocks, so KTX files must be authored bottom-up
+// (same orientation stb_image produces with flip-on-load).
+bool LoadKTX(const std::string& path, TextureData& tex) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return false;
+    fseek(f, 0, SEEK_END);
+    long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (fileSize <= 0) { fclose(f); return false; }
+    tex.blob.resize(fileSize);
+    bool readOk = fread(tex.blob.data(), 1, fileSize, f) == (size_t)fileSize;
+    fclose(f);
+
+    static const unsigned char ktxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+    const size_t headerSize = 12 + 13 * 4;
+    if (!readOk || tex.blob.size() < headerSize || memcmp(tex.blob.data(), ktxIdentifier, 12) != 0) return false;
+
+    uint32_t h[13];
+    memcpy(h, tex.blob.data() + 12, sizeof(h));
+    enum { KTX_ENDIAN, KTX_TYPE, KTX_TYPE_SIZE, KTX_FORMAT, KTX_INTERNAL_FORMAT, KTX_BASE_FORMAT,
+           KTX_WIDTH, KTX_HEIGHT, KTX_DEPTH, KTX_ARRAY, KTX_FACES, KTX_MIPS, KTX_KVD_BYTES };
+
+    // Only plain, little-endian, compressed 2D textures with a format the driver supports
+    bool supported = false;
+    for (GLint fmt : compressedFormats) supported |= (GLenum)fmt == h[KTX_INTERNAL_FORMAT];
+    if (h[KTX_ENDIAN] != 0x04030201 || h[KTX_TYPE] != 0 || h[KTX_DEPTH] > 1 || h[KTX_ARRAY] != 0 || h[KTX_FACES] != 1 || !supported) return false;
+
+    tex.internalFormat = h[KTX_INTERNAL_FORMAT];
+    tex.width = h[KTX_WIDTH];
+    tex.height = h[KTX_HEIGHT];
+
+    size_t offset = headerSize + h[KTX_KVD_BYTES];
+    uint32_t numLevels = h[KTX_MIPS] ? h[KTX_MIPS] : 1;
+    for (uint32_t level = 0; level < numLevels; level++) {
+        if (offset + 4 > tex.blob.size()) return false;
+        uint32_t imageSize;
+        memcpy(&imageSize, tex.blob.data() + offset, 4);
+        offset += 4;
+        if (offset + imageSize > tex.blob.size()) return false;
+
+        int w = std::max(1, tex.width >> level);
+        int hgt = std::max(1, tex.height >> level);
+        tex.levels.push_back({ w, hgt, offset, imageSize });
+        offset += (imageSize + 3) & ~3u; // mipPadding
+    }
+    return true;
+}
+
+// UPDATED: User requested path "models/textures/"
+std::string TexturePath(const std::string& filename) {
+    return "models/textures/" + filename;
+}
+
+// Pre-compressed copy next to the source image
+std::string KtxPath(const std::string& imagePath) {
+    return imagePath.substr(0, imagePath.find_last_of('.')) + ".ktx";
+}
+
+TextureData DecodeTexture(const char* filename) {
+    std::string fullPath = TexturePath(filename);
+
+    TextureData tex;
+
+    if (useCompressedTextures) {
+        if (LoadKTX(KtxPath(fullPath), tex)) return tex; // No stb decode at all
+        tex = TextureData();
+    }
+
+    stbi_set_flip_vertically_on_load_thread(true);
+    tex.pixels = stbi_load(fullPath.c_str(), &tex.width, &tex.height, &tex.channels, 0);
+
+    if (!tex.pixels) {
+        LogLine("Failed to load texture: " + fullPath + " (using white fallback)");
+    }
+    return tex;
+}
+
+// GL thread only. Frees the decoded pixels.
+GLuint UploadTexture(TextureData& tex) {
+    if (!tex.pixels && tex.levels.empty()) return 0;
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (!tex.levels.empty()) {
+        for (size_t level = 0; level < tex.levels.size(); level++) {
+            const TextureData::Level& l = tex.levels[level];
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, tex.internalFormat, l.width, l.height, 0, l.size, tex.blob.data() + l.offset);
+        }
+        // Compressed mips come from the file; without them fall back to plain linear
+        bool hasMips = useMipmaps && tex.levels.size() > 1;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, tex.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, hasMips ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        std::vector<unsigned char>().swap(tex.blob);
+        tex.levels.clear();
+        return textureID;
+    }
+
+    GLenum format = GL_RGB;
+    GLint internalFormat = GL_RGB8;
+    switch (tex.channels) {
+        case 1: format = GL_LUMINANCE;       internalFormat = GL_LUMINANCE8; break;
+        case 2: format = GL_LUMINANCE_ALPHA; internalFormat = GL_LUMINANCE8_ALPHA8; break;
+        case 4: format = GL_RGBA;            internalFormat = GL_RGBA8; break;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // stb rows are tightly packed
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, tex.width, tex.height, 0, format, GL_UNSIGNED_BYTE, tex.pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (useMipmaps) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+
+    stbi_image_free(tex.pixels);
+    tex.pixels = nullptr;
+    return textureID;
+}
+
+// GPU footprint of a decoded texture once uploaded (mip chain adds a third)
+size_t TextureDataBytes(const TextureData& tex) {
+    if (!tex.levels.empty()) {
+        size_t bytes = 0;
+        for (const TextureData::Level& l : tex.levels) bytes += l.size;
+        return bytes;
+    }
+    size_t bytes = (size_t)tex.width * tex.height * (tex.channels == 3 ? 4 : tex.channels); // RGB8 is padded to 4
+    return useMipmaps ? bytes * 4 / 3 : bytes;
+}
+
+void OnAssetFinished();
+void HotReloadTexture(Texture* t);
+
+// Shared, reference-counted texture. Decoded on the loader threads; id stays 0 until uploaded.
+Texture* GetTexture(const std::string& filename) {
+    if (Texture* t = textureRegistry.Acquire(filename)) return t;
+
+    Texture* t = textureRegistry.Create(filename);
+    t->name = filename;
+    fileWatcher.Watch(TexturePath(filename));
+    if (useCompressedTextures) fileWatcher.Watch(KtxPath(TexturePath(filename)));
+    if (pendingAssets++ == 0) loadStartTime = std::chrono::steady_clock::now();
+    WakeIdle();
+
+    auto job = [t] {
+        ProfileScope scope("Decode texture", t->name);
+        auto tex = std::make_shared<TextureData>(DecodeTexture(t->name.c_str()));
+        PostToMainThread([t, tex] {
+            if (t->unloadRequested) {
+                stbi_image_free(tex->pixels);
+                textureRegistry.Destroy(t);
+            } else {
+                ProfileScope scope("Upload texture", t->name);
+                size_t bytes = TextureDataBytes(*tex);
+                t->id = UploadTexture(*tex);
+                if (t->id) {
+                    t->bytes = bytes;
+                    gpuTextureBytes += bytes;
+                }
+                t->loaded = true;
+                glutPostRedisplay();
+                if (t->reloadQueued) HotReloadTexture(t); // Changed while it was loading
+            }
+            OnAssetFinished();
+        });
+    };
+
+    if (useAsyncLoading) loaderPool.Submit(job);
+    else { job(); PumpUploadQueue(); }
+    return t;
+}
+
+void DestroyTexture(Texture* t) {
+    if (t->id) glDeleteTextures(1, &t->id);
+    gpuTextureBytes -= t->bytes;
+    textureRegistry.Destroy(t);
+}
+
+void ReleaseTexture(Texture* t) {
+    if (!t || !textureRegistry.Release(t->name)) return;
+    fileWatcher.Unwatch(TexturePath(t->name));
+    if (useCompressedTextures) fileWatcher.Unwatch(KtxPath(TexturePath(t->name)));
+    if (!t->loaded || t->reloading) { t->unloadRequested = true; return; } // Upload callback frees it
+    DestroyTexture(t);
+}
+
+// Decodes the changed image on a loader thread and swaps the new GL texture in
+// under the same Texture, so every model (and static batch) using it picks it up
+// on the next frame. The old image stays if the new one doesn't decode.
+void HotReloadTexture(Texture* t) {
+    if (!t->loaded || t->reloading) { t->reloadQueued = true; return; }
+    t->reloading = true;
+    t->reloadQueued = false;
+    pendingReloads++; // Keeps idle() pumping until it lands
+    WakeIdle();
+
+    auto job = [t] {
+        ProfileScope scope("Reload texture", t->name);
+        auto tex = std::make_shared<TextureData>(DecodeTexture(t->name.c_str()));
+        PostToMainThread([t, tex] {
+            t->reloading = false;
+            pendingReloads--;
+            if (t->unloadRequested) {
+                stbi_image_free(tex->pixels);
+                DestroyTexture(t);
+                return;
+            }
+            size_t bytes = TextureDataBytes(*tex);
+            GLuint id = UploadTexture(*tex);
+            if (id) {
+                if (t->id) glDeleteTextures(1, &t->id);
+                gpuTextureBytes += bytes - t->bytes;
+                t->id = id;
+                t->bytes = bytes;
+                LogLine("Reloaded texture: " + t->name);
+                glutPostRedisplay();
+            } else {
+                LogLine("Reload of texture " + t->name + " failed, keeping the previous image");
+            }
+            if (t->reloadQueued) HotReloadTexture(t);
+        });
+    };
+
+    if (useAsyncLoading) loaderPool.Submit(job);
+    else { job(); PumpUploadQueue(); }
+}
+
+// ==========================================
+// 5. MODEL LOADING
+// ==========================================
+// ------------------------------------------
+// Load arena (import temporaries)
+// ------------------------------------------
+// Allocator for the scratch data of one model import: hash maps, adjacency and
+// remap tables, LOD and normal generation buffers, the OFF text. Each loader
+// thread has its own; LoadModelData rewinds it once the model is built. Blocks
+// come straight from mmap, so none of this ever lands on (or fragments) the
+// malloc heap; up to LOAD_ARENA_RETAIN bytes of them are kept for the next import.
+// Small allocations are recycled through power-of-two free lists (the LOD
+// simplifier's per-position lists grow and merge constantly); larger ones are
+// bump-allocated, and freeing the newest one of a block hands its space back.
+const size_t LOAD_ARENA_BLOCK = 4 << 20;
+const size_t LOAD_ARENA_RETAIN = 32 << 20;
+
+class LoadArena {
+public:
+    void* Allocate(size_t bytes, size_t align) {
+        int c = SizeClass(bytes, align);
+        if (c >= 0) {
+            if (FreeNode* n = freeLists[c]) {
+                freeLists[c] = n->next;
+                return n;
+            }
+            bytes = MIN_CLASS << c;
+            align = MIN_CLASS;  // Any later user of this slot may need full alignment
+        }
+        while (current < blocks.size()) {
+            Block& b = blocks[current];
+            size_t at = (b.used + align - 1) & ~(align - 1);
+            if (at + bytes <= b.size) {
+                b.used = at + bytes;
+                return b.data + at;
+            }
+            current++;
+        }
+        // Oversized requests get a block of their own
+        Block b;
+        b.size = (std::max(bytes, LOAD_ARENA_BLOCK) + 4095) & ~size_t(4095);
+        void* mapped = mmap(nullptr, b.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapped == MAP_FAILED) throw std::bad_alloc();
+        b.data = (char*)mapped;    // Page aligned
+        b.used = bytes;
+        blocks.push_back(b);
+        current = blocks.size() - 1;
+        reserved += b.size;
+        return b.data;
+    }
+
+    void Deallocate(void* p, size_t bytes, size_t align) {
+        int c = SizeClass(bytes, align);
+        if (c >= 0) {
+            FreeNode* n = (FreeNode*)p;
+            n->next = freeLists[c];
+            freeLists[c] = n;
+            return;
+        }
+        // Scratch buffers mostly die in reverse order, so the newest allocation of
+        // its block is the common case; the owner is searched newest block first
+        // (a bump may have moved past it, or an oversized block was added after)
+        // and, if it is not past the current one, becomes the place to bump from.
+        // An oversized block that empties is unmapped right away: the buffer it
+        // was sized for is gone and the next big one rarely fits.
+        for (size_t k = blocks.size(); k-- > 0;) {
+            Block& b = blocks[k];
+            if ((char*)p < b.data || (char*)p >= b.data + b.size) continue;
+            if ((char*)p + bytes != b.data + b.used) return;
+            b.used = (char*)p - b.data;
+            if (b.used == 0 && b.size > LOAD_ARENA_BLOCK) {
+                munmap(b.data, b.size);
+                reserved -= b.size;
+                blocks.erase(blocks.begin() + k);
+                if (current > k) current--;
+            } else if (k < current) {
+                current = k;
+            }
+            return;
+        }
+    }
+
+    // Forgets every allocation; blocks beyond LOAD_ARENA_RETAIN are unmapped
+    void Reset() {
+        size_t kept = 0, n = 0;
+        for (Block& b : blocks) {
+            if (kept + b.size <= LOAD_ARENA_RETAIN) {
+                kept += b.size;
+                b.used = 0;
+                blocks[n++] = b;
+            } else {
+                munmap(b.data, b.size);
+            }
+        }
+        blocks.resize(n);
+        reserved = kept;
+        current = 0;
+        for (FreeNode*& f : freeLists) f = nullptr;
+    }
+
+    size_t Reserved() const { return reserved; }
+
+    ~LoadArena() {
+        for (Block& b : blocks) munmap(b.data, b.size);
+    }
+
+private:
+    struct Block {
+        char* data;
+        size_t size;
+        size_t used;
+    };
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    static const size_t MIN_CLASS = 16;
+    static const int NUM_CLASSES = 9;   // 16 bytes .. 4 KB
+
+    // Free-list class of a small allocation, or -1 for the bump path
+    static int SizeClass(size_t bytes, size_t align) {
+        if (align > MIN_CLASS || bytes > (MIN_CLASS << (NUM_CLASSES - 1))) return -1;
+        int c = 0;
+        while ((MIN_CLASS << c) < bytes) c++;
+        return c;
+    }
+
+    std::vector<Block> blocks;
+    size_t current = 0;
+    size_t reserved = 0;
+    FreeNode* freeLists[NUM_CLASSES] = {};
+};
+
+thread_local LoadArena loadArena;
+
+// std allocator over the constructing thread's loadArena (containers must not outlive its Reset)
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    LoadArena* arena;
+
+    ArenaAllocator() : arena(&loadArena) {}
+    template <typename U> ArenaAllocator(const ArenaAllocator<U>& o) : arena(o.arena) {}
+
+    T* allocate(size_t n) { return (T*)arena->Allocate(n * sizeof(T), alignof(T)); }
+    void deallocate(T* p, size_t n) { arena->Deallocate(p, n * sizeof(T), alignof(T)); }
+
+    template <typename U> bool operator==(const ArenaAllocator<U>& o) const { return arena == o.arena; }
+    template <typename U> bool operator!=(const ArenaAllocator<U>& o) const { return arena != o.arena; }
+};
+
+template <typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+using ArenaHashMap = std::unordered_map<K, V, Hash, Eq, ArenaAllocator<std::pair<const K, V>>>;
+
+// Pushes the interleaved vertex array into one VBO and records the
+// pointer setup in a VAO so display() only binds + draws.
+void UploadModel(Model* m) {
+    m->vertexCount = m->vertices.size();
+    if (m->vertexCount == 0) return;
+
+    glGenVertexArrays(1, &m->vao);
+    glBindVertexArray(m->vao);
+
+    glGenBuffers(1, &m->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, m->vbo);
+    glBufferData(GL_ARRAY_BUFFER, m->vertices.size() * sizeof(Vertex), m->vertices.data(), GL_STATIC_DRAW);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, px));
+
+    if (m->hasNormals) {
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, nx));
+    }
+
+    if (m->hasTexcoords) {
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), (void*)offsetof(Vertex, u));
+    }
+
+    if (instancingSupported) {
+        glGenBuffers(1, &m->instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, m->instanceVBO);
+        for (GLuint col = 0; col < 4; col++) {
+            glEnableVertexAttribArray(ATTR_INSTANCE_MODEL + col);
+            glVertexAttribPointer(ATTR_INSTANCE_MODEL + col, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, model) + col * 4 * sizeof(float)));
+            glVertexAttribDivisor(ATTR_INSTANCE_MODEL + col, 1);
+        }
+        glEnableVertexAttribArray(ATTR_INSTANCE_COLOR);
+        glVertexAttribPointer(ATTR_INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, color));
+        glVertexAttribDivisor(ATTR_INSTANCE_COLOR, 1);
+    }
+
+    if (!m->indices.empty()) {
+        m->indexCount = m->indices.size();
+        glGenBuffers(1, &m->ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ibo); // Binding is stored in the VAO
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, m->indices.size() * sizeof(unsigned int), m->indices.data(), GL_STATIC_DRAW);
+    }
+    m->gpuBytes = m->vertices.size() * sizeof(Vertex) + m->indices.size() * sizeof(unsigned int);
+    gpuBufferBytes += m->gpuBytes;
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Deletes what UploadModel created
+void FreeModelBuffers(Model& mesh) {
+    if (mesh.instanceVBO) glDeleteBuffers(1, &mesh.instanceVBO);
+    if (mesh.ibo) glDeleteBuffers(1, &mesh.ibo);
+    if (mesh.vbo) glDeleteBuffers(1, &mesh.vbo);
+    if (mesh.vao) glDeleteVertexArrays(1, &mesh.vao);
+    gpuBufferBytes -= mesh.gpuBytes;
+    mesh.instanceVBO = mesh.ibo = mesh.vbo = mesh.vao = 0;
+    mesh.gpuBytes = 0;
+}
+
+// Tipsify (Sander et al. 2007): reorders triangles so consecutive ones reuse
+// vertices still sitting in the GPU's post-transform cache.
+std::vector<unsigned int> TipsifyIndices(const std::vector<unsigned int>& indices, size_t numVerts, int cacheSize) {
+    size_t numTris = indices.size() / 3;
+
+    // Vertex -> triangle adjacency (CSR layout)
+    ArenaVector<int> live(numVerts, 0);
+    for (unsigned int v : indices) live[v]++;
+    ArenaVector<size_t> offset(numVerts + 1, 0);
+    for (size_t v = 0; v < numVerts; v++) offset[v + 1] = offset[v] + live[v];
+    ArenaVector<size_t> adj(indices.size());
+    ArenaVector<size_t> fill(offset.begin(), offset.end() - 1);
+    for (size_t t = 0; t < numTris; t++) {
+        for (int k = 0; k < 3; k++) adj[fill[indices[3*t + k]]++] = t;
+    }
+
+    ArenaVector<int> cacheTime(numVerts, 0);
+    ArenaVector<uint8_t> emitted(numTris, 0);
+    ArenaVector<unsigned int> deadEnd;
+    ArenaVector<unsigned int> candidates;
+    std::vector<unsigned int> out;
+    out.reserve(indices.size());
+
+    int timeStamp = cacheSize + 1;
+    size_t cursor = 0;
+    long fan = numVerts > 0 ? 0 : -1;
+
+    while (fan >= 0) {
+        candidates.clear();
+
+        // Emit every remaining triangle around the fanning vertex
+        for (size_t a = offset[fan]; a < offset[fan + 1]; a++) {
+            size_t t = adj[a];
+            if (emitted[t]) continue;
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = indices[3*t + k];
+                out.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (timeStamp - cacheTime[v] > cacheSize) cacheTime[v] = timeStamp++;
+            }
+            emitted[t] = 1;
+        }
+
+        // Next fan: the candidate that stays in cache longest, else a dead-end / any live vertex
+        fan = -1;
+        int best = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] <= 0) continue;
+            int priority = 0;
+            if (timeStamp - cacheTime[v] + 2 * live[v] <= cacheSize) priority = timeStamp - cacheTime[v];
+            if (priority > best) { best = priority; fan = v; }
+        }
+        while (fan < 0 && !deadEnd.empty()) {
+            unsigned int d = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[d] > 0) fan = d;
+        }
+        while (fan < 0 && cursor < numVerts) {
+            if (live[cursor] > 0) fan = cursor;
+            cursor++;
+        }
+    }
+    return out;
+}
+
+// Renumbers vertices in first-use order so the fetch stream follows the index stream.
+void ReorderVerticesByFirstUse(Model* m) {
+    ArenaVector<unsigned int> remap(m->vertices.size(), ~0u);
+    std::vector<Vertex> vertices;
+    vertices.reserve(m->vertices.size());
+
+    for (unsigned int& idx : m->indices) {
+        if (remap[idx] == ~0u) {
+            remap[idx] = vertices.size();
+            vertices.push_back(m->vertices[idx]);
+        }
+        idx = remap[idx];
+    }
+    m->vertices.swap(vertices);
+
+    if (m->tangents.empty()) return;
+    std::vector<Tangent> tangents(m->vertices.size());
+    for (size_t v = 0; v < remap.size(); v++) {
+        if (remap[v] != ~0u) tangents[remap[v]] = m->tangents[v];
+    }
+    m->tangents.swap(tangents);
+}
+
+void GenerateNormals(Model* m, bool uniquePositions);  // Rendering: normal generation (below)
+void GenerateTangents(Model* m);
+
+// Gathers one OBJ corner into an interleaved vertex (zeros for missing normal/uv).
+Vertex MakeVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& index) {
+    Vertex v = {};
+    v.px = attrib.vertices[3 * index.vertex_index + 0];
+    v.py = attrib.vertices[3 * index.vertex_index + 1];
+    v.pz = attrib.vertices[3 * index.vertex_index + 2];
+
+    if (index.normal_index >= 0) {
+        v.nx = attrib.normals[3 * index.normal_index + 0];
+        v.ny = attrib.normals[3 * index.normal_index + 1];
+        v.nz = attrib.normals[3 * index.normal_index + 2];
+    }
+
+    if (index.texcoord_index >= 0) {
+        v.u = attrib.texcoords[2 * index.texcoord_index + 0];
+        v.v = attrib.texcoords[2 * index.texcoord_index + 1];
+    }
+    return v;
+}
+
+size_t CountCorners(const std::vector<tinyobj::shape_t>& shapes) {
+    size_t n = 0;
+    for (const auto& shape : shapes) n += shape.mesh.indices.size();
+    return n;
+}
+
+struct ObjIndexHash {
+    size_t operator()(const tinyobj::index_t& i) const {
+        size_t h = std::hash<int>()(i.vertex_index);
+        h = h * 31 + std::hash<int>()(i.normal_index);
+        h = h * 31 + std::hash<int>()(i.texcoord_index);
+        return h;
+    }
+};
+
+struct ObjIndexEqual {
+    bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const {
+        return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+    }
+};
+
+// Indexed path: one vertex per unique (pos, normal, uv) tuple, then cache-optimised order.
+void BuildIndexedMesh(Model* m, const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes) {
+    size_t numCorners = CountCorners(shapes);
+    ArenaHashMap<tinyobj::index_t, unsigned int, ObjIndexHash, ObjIndexEqual> uniqueVerts;
+    uniqueVerts.reserve(numCorners);
+    m->indices.reserve(numCorners);
+    m->vertices.reserve(numCorners); // Upper bound, trimmed below
+
+    for (const auto& shape : shapes) {
+        for (const auto& index : shape.mesh.indices) {
+            auto ins = uniqueVerts.emplace(index, (unsigned int)m->vertices.size());
+            if (ins.second) m->vertices.push_back(MakeVertex(attrib, index));
+            m->indices.push_back(ins.first->second);
+        }
+    }
+    m->vertices.shrink_to_fit();
+
+    m->indices = TipsifyIndices(m->indices, m->vertices.size(), VERTEX_CACHE_SIZE);
+    ReorderVerticesByFirstUse(m);
+}
+
+// tinyobj's MTL reader, noting which file the OBJ asked for so the mesh cache can
+// key on it and hot reload can watch it (found or not: a missing MTL that shows
+// up later counts as a change)
+class TrackingMaterialReader : public tinyobj::MaterialFileReader {
+public:
+    TrackingMaterialReader() : tinyobj::MaterialFileReader("models/") {}
+
+    bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials,
+                    std::map<std::string, int>* matMap, std::string* warn, std::string* err) override {
+        if (path.empty()) path = "models/" + matId;
+        return tinyobj::MaterialFileReader::operator()(matId, materials, matMap, warn, err);
+    }
+
+    std::string path;   // First mtllib of the OBJ
+};
+
+// Parses the OBJ (+ MTL) and builds the CPU-side mesh. No GL calls.
+bool ImportObj(Model* m, const std::string& fullPath) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    std::ifstream in(fullPath);
+    if (!in) {
+        std::cout << "FAILED! Cannot open file [" << fullPath << "]" << std::endl;
+        return false;
+    }
+    TrackingMaterialReader materialReader;
+    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &in, &materialReader);
+
+    if (!warn.empty()) std::cout << "WARN: " << warn << std::endl;
+    if (!ret) {
+        std::cout << "FAILED! " << err << std::endl;
+        return false;
+    }
+    m->materialPath = materialReader.path;
+
+    // tinyobj only warns about out-of-range indices; a truncated or half-saved file
+    // (hot reload) must fail the import instead of reading past the arrays
+    int numPositions = attrib.vertices.size() / 3;
+    int numNormals = attrib.normals.size() / 3;
+    int numTexcoords = attrib.texcoords.size() / 2;
+    bool missingNormals = false;    // A corner without a vn (MakeVertex leaves it zero)
+    for (const auto& shape : shapes) {
+        for (const auto& index : shape.mesh.indices) {
+            if (index.vertex_index < 0 || index.vertex_index >= numPositions
+                || index.normal_index >= numNormals || index.texcoord_index >= numTexcoords) {
+                std::cout << "FAILED! " << fullPath << ": index out of range in shape " << shape.name << std::endl;
+                return false;
+            }
+            missingNormals |= index.normal_index < 0;
+        }
+    }
+
+    // Texture name from MTL if available
+    if (!materials.empty() && !materials[0].diffuse_texname.empty()) {
+        std::string rawName = materials[0].diffuse_texname;
+        size_t lastSlash = rawName.find_last_of("/\\");
+        m->textureName = (lastSlash == std::string::npos) ? rawName : rawName.substr(lastSlash + 1);
+    }
+
+    m->hasNormals = !attrib.normals.empty();
+    m->hasTexcoords = !attrib.texcoords.empty();
+
+    if (useIndexedMeshes) {
+        BuildIndexedMesh(m, attrib, shapes);
+    } else {
+        // Sized once up front, then filled in place
+        m->vertices.resize(CountCorners(shapes));
+        size_t i = 0;
+        for (const auto& shape : shapes) {
+            for (const auto& index : shape.mesh.indices) {
+                m->vertices[i++] = MakeVertex(attrib, index);
+            }
+        }
+    }
+
+    if (!m->hasNormals) {
+        GenerateNormals(m, false);
+    } else if (missingNormals) {
+        // Only part of the mesh has normals: generate them all, then put the authored
+        // ones back (the corners without one are the zero vectors)
+        ArenaVector<float> authored(3 * m->vertices.size());
+        for (size_t v = 0; v < m->vertices.size(); v++) {
+            authored[3 * v + 0] = m->vertices[v].nx;
+            authored[3 * v + 1] = m->vertices[v].ny;
+            authored[3 * v + 2] = m->vertices[v].nz;
+        }
+        GenerateNormals(m, false);
+        for (size_t v = 0; v < m->vertices.size(); v++) {
+            const float* n = &authored[3 * v];
+            if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f) continue;
+            m->vertices[v].nx = n[0];
+            m->vertices[v].ny = n[1];
+            m->vertices[v].nz = n[2];
+        }
+    }
+    if (m->hasTexcoords) GenerateTangents(m);
+    return true;
+}
+
+// Reads up to maxCount numbers from [p, eol), stopping at a comment. Returns how many.
+int ReadOffNumbers(const char* p, const char* eol, double* out, int maxCount) {
+    int n = 0;
+    while (n < maxCount) {
+        while (p < eol && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p == eol || *p == '#') break;
+        char* next;
+        double x = strtod(p, &next);
+        if (next == p || next > eol) break;
+        out[n++] = x;
+        p = next;
+    }
+    return n;
+}
+
+// Parses an OFF mesh ([ST][C][N]OFF header: optional per-vertex texcoords, colors,
+// normals; '#' comments) into an indexed mesh, polygons split into triangle fans.
+// Normals / tangents are generated on the shared vertices, before any soup expansion.
+bool ImportOff(Model* m, const std::string& fullPath) {
+    FILE* f = fopen(fullPath.c_str(), "rb");
+    if (!f) {
+        std::cout << "FAILED! Cannot open " << fullPath << std::endl;
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long fileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    ArenaVector<char> text(std::max(0L, fileSize));
+    bool readOk = fileSize > 0 && fread(text.data(), 1, fileSize, f) == (size_t)fileSize;
+    fclose(f);
+    if (!readOk) {
+        std::cout << "FAILED! Cannot read " << fullPath << std::endl;
+        return false;
+    }
+
+    // Next line with content (comment-only and blank lines skipped)
+    const char* cursor = text.data();
+    const char* textEnd = cursor + text.size();
+    const char* line = nullptr;
+    const char* eol = nullptr;
+    int lineNumber = 0;
+    auto nextLine = [&]() {
+        while (cursor < textEnd) {
+            line = cursor;
+            eol = (const char*)memchr(cursor, '\n', textEnd - cursor);
+            if (!eol) eol = textEnd;
+            cursor = eol + 1;
+            lineNumber++;
+            const char* p = line;
+            while (p < eol && isspace((unsigned char)*p)) p++;
+            if (p < eol && *p != '#') { line = p; return true; }
+        }
+        return false;
+    };
+    auto fail = [&](const std::string& msg) {
+        std::cout << "FAILED! " << fullPath << " line " << lineNumber << ": " << msg << std::endl;
+        return false;
+    };
+
+    // Header keyword (may be omitted, and may share its line with the counts)
+    if (!nextLine()) return fail("empty file");
+    bool hasTexcoords = false, hasNormals = false;
+    const char* keyEnd = line;
+    while (keyEnd < eol && isalnum((unsigned char)*keyEnd)) keyEnd++;
+    std::string keyword(line, keyEnd);
+    if (keyword.size() >= 3 && keyword.compare(keyword.size() - 3, 3, "OFF") == 0) {
+        std::string prefix = keyword.substr(0, keyword.size() - 3);
+        if (prefix.compare(0, 2, "ST") == 0) { hasTexcoords = true; prefix.erase(0, 2); }
+        if (!prefix.empty() && prefix[0] == 'C') prefix.erase(0, 1);
+        if (!prefix.empty() && prefix[0] == 'N') { hasNormals = true; prefix.erase(0, 1); }
+        if (!prefix.empty()) return fail("unsupported OFF variant " + keyword); // 4OFF / nOFF
+        line = keyEnd;
+    }
+
+    double counts[3];
+    if (ReadOffNumbers(line, eol, counts, 3) < 2) {
+        if (!nextLine() || ReadOffNumbers(line, eol, counts, 3) < 2) return fail("expected vertex and face counts");
+    }
+    if (counts[0] < 0 || counts[1] < 0 || counts[0] >= 4294967295.0 || counts[1] >= 4294967295.0) return fail("bad counts");
+    uint32_t numVerts = (uint32_t)counts[0], numFaces = (uint32_t)counts[1];
+
+    // Each number takes at least a digit and a separator (the last one may lack it), so a
+    // header claiming more than the rest of the file can hold fails before allocating
+    int needed = 3 + (hasNormals ? 3 : 0) + (hasTexcoords ? 2 : 0);
+    uint64_t minBytes = (uint64_t)numVerts * needed * 2 + (uint64_t)numFaces * 2;
+    if (minBytes > (uint64_t)(textEnd - cursor) + 1) return fail("bad counts");
+
+    m->vertices.resize(numVerts);
+    for (uint32_t i = 0; i < numVerts; i++) {
+        double x[16];
+        int n = nextLine() ? ReadOffNumbers(line, eol, x, 16) : 0;
+        if (n < needed) return fail("expected " + std::to_string(needed) + " numbers per vertex");
+        Vertex& v = m->vertices[i];
+        v = {};
+        v.px = (float)x[0]; v.py = (float)x[1]; v.pz = (float)x[2];
+        if (hasNormals) { v.nx = (float)x[3]; v.ny = (float)x[4]; v.nz = (float)x[5]; }
+        if (hasTexcoords) { v.u = (float)x[n - 2]; v.v = (float)x[n - 1]; } // After the optional color
+    }
+
+    m->indices.reserve((size_t)numFaces * 3);
+    for (uint32_t i = 0; i < numFaces; i++) {
+        if (!nextLine()) return fail("expected " + std::to_string(numFaces) + " faces");
+        const char* p = line;
+        char* next;
+        long corners = strtol(p, &next, 10);
+        if (next == p || next > eol || corners < 0) return fail("bad face");
+        p = next;
+
+        // Fan: (c0, c1, c2), (c0, c2, c3), ...; any color after the indices is ignored
+        unsigned int first = 0, prev = 0;
+        for (long c = 0; c < corners; c++) {
+            long idx = strtol(p, &next, 10);
+            if (next == p || next > eol) return fail("face has fewer indices than its count");
+            if (idx < 0 || idx >= (long)numVerts) return fail("vertex index " + std::to_string(idx) + " out of range");
+            p = next;
+            if (c == 0) first = idx;
+            if (c >= 2) {
+                m->indices.push_back(first);
+                m->indices.push_back(prev);
+                m->indices.push_back(idx);
+            }
+            prev = idx;
+        }
+    }
+
+    m->hasNormals = hasNormals;
+    m->hasTexcoords = hasTexcoords;
+    if (!m->hasNormals) GenerateNormals(m, true); // OFF vertices are already one per position
+    if (m->hasTexcoords) GenerateTangents(m);
+
+    if (useIndexedMeshes) {
+        m->indices = TipsifyIndices(m->indices, m->vertices.size(), VERTEX_CACHE_SIZE);
+        ReorderVerticesByFirstUse(m); // Also drops vertices no face uses
+    } else {
+        std::vector<Vertex> soup(m->indices.size());
+        std::vector<Tangent> soupTangents(m->tangents.empty() ? 0 : m->indices.size());
+        for (size_t i = 0; i < m->indices.size(); i++) {
+            soup[i] = m->vertices[m->indices[i]];
+            if (!soupTangents.empty()) soupTangents[i] = m->tangents[m->indices[i]];
+        }
+        m->vertices.swap(soup);
+        m->tangents.swap(soupTangents);
+        m->indices.clear();
+        m->indices.shrink_to_fit();
+    }
+    return true;
+}
+
+bool IsOffFile(const std::string& path) {
+    if (path.size() < 4) return false;
+    std::string ext = path.substr(path.size() - 4);
+    for (char& c : ext) c = tolower((unsigned char)c);
+    return ext == ".off";
+}
+
+// ------------------------------------------
+// LOD chain (Garland-Heckbert quadric error metrics)
+// ------------------------------------------
+// Half-edge collapses onto existing vertices, so every LOD is just another index
+// range over the same vertex buffer. Vertices sharing a position (normal / UV
+// seams) collapse together, each onto a partner on the same side of the seam.
+
+// Symmetric 4x4 plane quadric (upper triangle) plus the area it was built from
+struct Quadric {
+    double a[10] = {};
+    double weight = 0.0;
+
+    void AddPlane(double nx, double ny, double nz, double d, double w) {
+        double p[4] = { nx, ny, nz, d };
+        int k = 0;
+        for (int r = 0; r < 4; r++) {
+            for (int c = r; c < 4; c++) a[k++] += w * p[r] * p[c];
+        }
+        weight += w;
+    }
+
+    void Add(const Quadric& q) {
+        for (int k = 0; k < 10; k++) a[k] += q.a[k];
+        weight += q.weight;
+    }
+
+    // Area-weighted RMS distance of p to the accumulated planes
+    float Error(const float p[3]) const {
+        double x = p[0], y = p[1], z = p[2];
+        double e = a[0]*x*x + 2*a[1]*x*y + 2*a[2]*x*z + 2*a[3]*x
+                 + a[4]*y*y + 2*a[5]*y*z + 2*a[6]*y
+                 + a[7]*z*z + 2*a[8]*z
+                 + a[9];
+        return weight > 0.0 ? (float)sqrt(std::max(0.0, e) / weight) : 0.0f;
+    }
+};
+
+struct PositionHash {
+    size_t operator()(const Vertex& v) const {
+        size_t h = std::hash<float>()(v.px);
+        h = h * 31 + std::hash<float>()(v.py);
+        h = h * 31 + std::hash<float>()(v.pz);
+        return h;
+    }
+};
+
+struct PositionEqual {
+    bool operator()(const Vertex& a, const Vertex& b) const {
+        return a.px == b.px && a.py == b.py && a.pz == b.pz;
+    }
+};
+
+struct EdgeCollapse {
+    float error;
+    uint32_t from, to;                  // Positions: from moves onto to
+    uint32_t fromVersion, toVersion;    // Stale once either quadric changed
+    bool operator>(const EdgeCollapse& o) const { return error > o.error; }
+};
+
+class MeshSimplifier {
+public:
+    explicit MeshSimplifier(const Model* m) : vertices(m->vertices), tris(m->indices.begin(), m->indices.end()) {
+        size_t numVerts = vertices.size();
+        ArenaHashMap<Vertex, uint32_t, PositionHash, PositionEqual> unique;
+        unique.reserve(numVerts);
+        posOf.resize(numVerts);
+        for (size_t v = 0; v < numVerts; v++) {
+            auto ins = unique.emplace(vertices[v], (uint32_t)unique.size());
+            posOf[v] = ins.first->second;
+            if (ins.second) position.push_back(&vertices[v].px);
+        }
+
+        size_t numPos = position.size();
+        quadric.resize(numPos);
+        posTris.resize(numPos);
+        alive.assign(numPos, 1);
+        version.assign(numPos, 0);
+        liveTris = tris.size() / 3;
+        triAlive.assign(liveTris, 1);
+
+        // Face planes, weighted by area. Edges (welded position pairs) are collected
+        // and sorted rather than counted in a hash map: one buffer instead of a node each
+        ArenaVector<uint64_t> edges;
+        edges.reserve(tris.size());
+        for (uint32_t t = 0; t < liveTris; t++) {
+            float n[3];
+            float area = 0.5f * TriangleNormal(Pos(t, 0), Pos(t, 1), Pos(t, 2), n);
+            for (int k = 0; k < 3; k++) {
+                uint32_t p = posOf[tris[3*t + k]];
+                posTris[p].push_back(t);
+                if (area > 0.0f) quadric[p].AddPlane(n[0], n[1], n[2], -Dot(n, position[p]), area);
+                edges.push_back(EdgeKey(p, posOf[tris[3*t + (k + 1) % 3]]));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        auto edgeUse = [&](uint64_t key) {
+            auto range = std::equal_range(edges.begin(), edges.end(), key);
+            return range.second - range.first;
+        };
+
+        // Open borders: a plane through the edge, perpendicular to its face, keeps the outline in place
+        for (uint32_t t = 0; t < liveTris; t++) {
+            float n[3];
+            if (TriangleNormal(Pos(t, 0), Pos(t, 1), Pos(t, 2), n) <= 0.0f) continue;
+            for (int k = 0; k < 3; k++) {
+                uint32_t a = posOf[tris[3*t + k]], b = posOf[tris[3*t + (k + 1) % 3]];
+                if (edgeUse(EdgeKey(a, b)) != 1) continue;
+                float e[3] = { position[b][0] - position[a][0], position[b][1] - position[a][1], position[b][2] - position[a][2] };
+                float len2 = Dot(e, e);
+                float side[3] = { e[1]*n[2] - e[2]*n[1], e[2]*n[0] - e[0]*n[2], e[0]*n[1] - e[1]*n[0] };
+                float sideLen = sqrt(Dot(side, side));
+                if (sideLen <= 0.0f) continue;
+                for (float& s : side) s /= sideLen;
+                double w = BORDER_WEIGHT * len2;
+                quadric[a].AddPlane(side[0], side[1], side[2], -Dot(side, position[a]), w);
+                quadric[b].AddPlane(side[0], side[1], side[2], -Dot(side, position[a]), w);
+            }
+        }
+
+        ArenaVector<EdgeCollapse> heap;
+        heap.reserve(12 * triAlive.size()); // Every edge both ways (6 per triangle), plus the re-pushes of collapses
+        queue = decltype(queue)(std::greater<EdgeCollapse>(), std::move(heap));
+        for (uint32_t t = 0; t < triAlive.size(); t++) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t a = posOf[tris[3*t + k]], b = posOf[tris[3*t + (k + 1) % 3]];
+                PushCollapse(a, b);
+                PushCollapse(b, a);
+            }
+        }
+    }
+
+    size_t TriangleCount() const { return liveTris; }
+    float MaxError() const { return maxError; }
+
+    // Collapses the cheapest edges until at most targetTris remain.
+    // Returns false once no collapse is left that keeps the mesh valid.
+    bool Simplify(size_t targetTris) {
+        while (liveTris > targetTris) {
+            if (queue.empty()) return false;
+            EdgeCollapse c = queue.top();
+            queue.pop();
+            if (!alive[c.from] || !alive[c.to] || version[c.from] != c.fromVersion || version[c.to] != c.toVersion) continue;
+            if (Collapse(c.from, c.to)) maxError = std::max(maxError, c.error);
+        }
+        return true;
+    }
+
+    // Current triangles, as vertex indices into the original vertex buffer
+    std::vector<unsigned int> Indices() const {
+        std::vector<unsigned int> out;
+        out.reserve(liveTris * 3);
+        for (uint32_t t = 0; t < triAlive.size(); t++) {
+            if (triAlive[t]) out.insert(out.end(), tris.begin() + 3*t, tris.begin() + 3*t + 3);
+        }
+        return out;
+    }
+
+private:
+    static constexpr double BORDER_WEIGHT = 10.0;
+
+    static float Dot(const float a[3], const float b[3]) { return a[0]*b[0] + a[1]*b[1] + a[2]*b[2]; }
+    static uint64_t EdgeKey(uint32_t a, uint32_t b) { return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a; }
+
+    // Unit normal into n, returns twice the area
+    static float TriangleNormal(const float* a, const float* b, const float* c, float n[3]) {
+        float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+        n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+        n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+        float len = sqrt(Dot(n, n));
+        if (len > 0.0f) for (int k = 0; k < 3; k++) n[k] /= len;
+        return len;
+    }
+
+    const float* Pos(uint32_t t, int k) const { return position[posOf[tris[3*t + k]]]; }
+
+    void PushCollapse(uint32_t from, uint32_t to) {
+        if (from == to) return;
+        Quadric q = quadric[from];
+        q.Add(quadric[to]);
+        queue.push({ q.Error(position[to]), from, to, version[from], version[to] });
+    }
+
+    // Live triangles around position p (drops dead entries on the way)
+    ArenaVector<uint32_t>& LiveTris(uint32_t p) {
+        ArenaVector<uint32_t>& list = posTris[p];
+        list.erase(std::remove_if(list.begin(), list.end(), [this](uint32_t t) { return !triAlive[t]; }), list.end());
+        return list;
+    }
+
+    int CornerAt(uint32_t t, uint32_t p) const {
+        for (int k = 0; k < 3; k++) if (posOf[tris[3*t + k]] == p) return k;
+        return -1;
+    }
+
+    bool Collapse(uint32_t from, uint32_t to) {
+        ArenaVector<uint32_t>& around = LiveTris(from);
+
+        // Each vertex at `from` moves onto the vertex at `to` it shares a triangle with;
+        // a vertex with no such partner (other side of a seam) blocks the collapse.
+        ArenaVector<std::pair<unsigned int, unsigned int>> wedgeMap;
+        auto mapped = [&](unsigned int v) -> unsigned int {
+            for (const auto& w : wedgeMap) if (w.first == v) return w.second;
+            return ~0u;
+        };
+        ArenaVector<uint32_t> neighbors;
+        int sharedTris = 0;
+        for (uint32_t t : around) {
+            int kFrom = CornerAt(t, from), kTo = CornerAt(t, to);
+            for (int k = 0; k < 3; k++) if (k != kFrom && k != kTo) neighbors.push_back(posOf[tris[3*t + k]]);
+            if (kTo < 0) continue;
+            sharedTris++;
+            unsigned int a = tris[3*t + kFrom], b = tris[3*t + kTo];
+            unsigned int prev = mapped(a);
+            if (prev == ~0u) wedgeMap.push_back({ a, b });
+            else if (prev != b) return false;
+        }
+        if (sharedTris == 0) return false;
+
+        // Link condition: the two ends may only share the neighbors of the triangles on
+        // their edge, otherwise the collapse pinches the surface into a non-manifold fold
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        int common = 0;
+        for (uint32_t t : LiveTris(to)) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t p = posOf[tris[3*t + k]];
+                if (p == to || p == from) continue;
+                auto it = std::lower_bound(neighbors.begin(), neighbors.end(), p);
+                if (it != neighbors.end() && *it == p) { common++; neighbors.erase(it); }
+            }
+        }
+        if (common > sharedTris) return false;
+
+        // Surviving triangles must keep a valid, roughly unchanged orientation
+        for (uint32_t t : around) {
+            int kFrom = CornerAt(t, from);
+            if (CornerAt(t, to) >= 0) continue;
+            if (mapped(tris[3*t + kFrom]) == ~0u) return false;
+            const float* p[3] = { Pos(t, 0), Pos(t, 1), Pos(t, 2) };
+            float before[3], after[3];
+            bool wasDegenerate = TriangleNormal(p[0], p[1], p[2], before) <= 0.0f;
+            p[kFrom] = position[to];
+            if (TriangleNormal(p[0], p[1], p[2], after) <= 0.0f) return false;
+            if (!wasDegenerate && Dot(before, after) < 0.25f) return false;
+        }
+
+        ArenaVector<uint32_t>& target = posTris[to];
+        for (uint32_t t : around) {
+            int kFrom = CornerAt(t, from);
+            if (CornerAt(t, to) >= 0) {
+                triAlive[t] = 0;
+                liveTris--;
+                continue;
+            }
+            tris[3*t + kFrom] = mapped(tris[3*t + kFrom]);
+            target.push_back(t);
+        }
+        around.clear();
+        alive[from] = 0;
+        quadric[to].Add(quadric[from]);
+        version[to]++;
+
+        for (uint32_t t : LiveTris(to)) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t p = posOf[tris[3*t + k]];
+                if (p == to) continue;
+                PushCollapse(p, to);
+                PushCollapse(to, p);
+            }
+        }
+        return true;
+    }
+
+    const std::vector<Vertex>& vertices;
+    ArenaVector<unsigned int> tris;     // Current triangles (vertex indices)
+    ArenaVector<uint8_t> triAlive;
+    size_t liveTris = 0;
+
+    ArenaVector<uint32_t> posOf;        // Vertex -> welded position
+    ArenaVector<const float*> position;
+    ArenaVector<Quadric> quadric;
+    ArenaVector<ArenaVector<uint32_t>> posTris;
+    ArenaVector<uint8_t> alive;
+    ArenaVector<uint32_t> version;
+
+    std::priority_queue<EdgeCollapse, ArenaVector<EdgeCollapse>, std::greater<EdgeCollapse>> queue;
+    float maxError = 0.0f;
+};
+
+// Appends up to MAX_MESH_LODS - 1 simplified levels (half the triangles each) to
+// m->indices and records them in m->lods. Stops when a level no longer gets
+// meaningfully smaller. No GL calls.
+void BuildLodChain(Model* m) {
+    m->lods.clear();
+    if (m->indices.empty()) return;
+    m->lods.push_back({ 0, (uint32_t)m->indices.size(), 0.0f });
+
+    MeshSimplifier simplifier(m);
+    size_t previous = simplifier.TriangleCount();
+    while ((int)m->lods.size() < MAX_MESH_LODS && previous >= 2 * LOD_MIN_TRIANGLES) {
+        bool more = simplifier.Simplify(previous / 2);
+        size_t count = simplifier.TriangleCount();
+        if (count > previous * 3 / 4) break; // Stuck on seams / borders
+
+        std::vector<unsigned int> level = TipsifyIndices(simplifier.Indices(), m->vertices.size(), VERTEX_CACHE_SIZE);
+        m->lods.push_back({ (uint32_t)m->indices.size(), (uint32_t)level.size(), simplifier.MaxError() });
+        m->indices.insert(m->indices.end(), level.begin(), level.end());
+        previous = count;
+        if (!more) break;
+    }
+}
+
+// ------------------------------------------
+// Binary mesh cache ("<file>.obj.meshcache", "<file>.off.meshcache")
+// ------------------------------------------
+// Layout: header | texture name | material path | pad to 4 | Vertex[vertexCount] | uint32[indexCount] | MeshLod[lodCount]
+//         | Tangent[vertexCount] (MESH_CACHE_TANGENTS)
+struct MeshCacheHeader {
+    char magic[4];          // "MSHC"
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t sourceHash;    // FNV-1a of the source bytes
+    uint64_t materialHash;  // Same for the MTL (0 = none or missing): an edited MTL can change the texture
+    uint32_t flags;
+    uint32_t vertexCount;
+    uint32_t indexCount;            // All LODs
+    uint32_t textureNameLength;
+    uint32_t lodCount;
+    uint32_t materialPathLength;    // Model::materialPath, checked against materialHash on load (and watched)
+};
+
+enum MeshCacheFlags : uint32_t {
+    MESH_CACHE_INDEXED   = 1 << 0,
+    MESH_CACHE_NORMALS   = 1 << 1,
+    MESH_CACHE_TEXCOORDS = 1 << 2,
+    MESH_CACHE_TANGENTS  = 1 << 3,
+    MESH_CACHE_GENERATED_NORMALS = 1 << 4,  // + MESH_CACHE_ANGLE_WEIGHTED for NORMALS_ANGLE
+    MESH_CACHE_ANGLE_WEIGHTED    = 1 << 5,
+};
+
+uint64_t HashFile(const std::string& path) {
+    uint64_t h = 1469598103934665603ull;
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return 0;
+    unsigned char buf[64 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        for (size_t i = 0; i < n; i++) { h ^= buf[i]; h *= 1099511628211ull; }
+    }
+    fclose(f);
+    return h;
+}
+
+size_t MeshCacheDataOffset(const MeshCacheHeader& h) {
+    return (sizeof(MeshCacheHeader) + h.textureNameLength + h.materialPathLength + 3) & ~size_t(3);
+}
+
+// Maps the cache and copies it into m. Returns false if it is missing or stale.
+bool LoadMeshCache(Model* m, const std::string& objPath) {
+    struct stat src;
+    if (stat(objPath.c_str(), &src) != 0) return false;
+
+    std::string cachePath = objPath + ".meshcache";
+    int fd = open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MeshCacheHeader)) { close(fd); return false; }
+
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    const char* base = (const char*)mapped;
+    MeshCacheHeader h;
+    memcpy(&h, base, sizeof(h));
+
+    bool wantIndexed = useIndexedMeshes;
+    bool ok = memcmp(h.magic, "MSHC", 4) == 0
+           && h.version == MESH_CACHE_VERSION
+           && ((h.flags & MESH_CACHE_INDEXED) != 0) == wantIndexed;
+
+    // Generated normals are only reused if they were built with today's weighting
+    bool generated = (h.flags & MESH_CACHE_GENERATED_NORMALS) != 0;
+    ok = ok && (!generated || ((h.flags & MESH_CACHE_ANGLE_WEIGHTED) != 0) == (normalWeighting == NORMALS_ANGLE));
+
+    size_t dataOffset = MeshCacheDataOffset(h);
+    size_t lodOffset = dataOffset + (size_t)h.vertexCount * sizeof(Vertex) + (size_t)h.indexCount * sizeof(uint32_t);
+    size_t tangentOffset = lodOffset + (size_t)h.lodCount * sizeof(MeshLod);
+    size_t tangentCount = (h.flags & MESH_CACHE_TANGENTS) ? h.vertexCount : 0;
+    ok = ok && tangentOffset + tangentCount * sizeof(Tangent) == (size_t)st.st_size;
+
+    // Every indexed mesh has at least LOD 0, and each range must lie inside the indices
+    const MeshLod* lods = (const MeshLod*)(base + lodOffset);
+    ok = ok && (h.indexCount == 0) == (h.lodCount == 0);
+    for (uint32_t l = 0; ok && l < h.lodCount; l++) ok = (uint64_t)lods[l].indexOffset + lods[l].indexCount <= h.indexCount;
+
+    // ...and every index must name a vertex (a corrupt or foreign file of the right size)
+    const uint32_t* idx = (const uint32_t*)(base + dataOffset + (size_t)h.vertexCount * sizeof(Vertex));
+    for (uint32_t k = 0; ok && k < h.indexCount; k++) ok = idx[k] < h.vertexCount;
+
+    // Same size + mtime -> trust it. Otherwise fall back to comparing content hashes
+    // so a touch/checkout without edits doesn't force a re-parse.
+    if (ok && (h.sourceSize != (uint64_t)src.st_size || h.sourceMtime != (int64_t)src.st_mtime)) {
+        ok = h.sourceSize == (uint64_t)src.st_size && h.sourceHash == HashFile(objPath);
+    }
+
+    std::string materialPath;
+    if (ok) {
+        materialPath.assign(base + sizeof(MeshCacheHeader) + h.textureNameLength, h.materialPathLength);
+        ok = materialPath.empty() || HashFile(materialPath) == h.materialHash;
+    }
+
+    if (ok) {
+        m->textureName.assign(base + sizeof(MeshCacheHeader), h.textureNameLength);
+        m->materialPath = materialPath;
+        m->hasNormals = (h.flags & MESH_CACHE_NORMALS) != 0;
+        m->hasTexcoords = (h.flags & MESH_CACHE_TEXCOORDS) != 0;
+        m->normalsGenerated = generated;
+
+        const Vertex* verts = (const Vertex*)(base + dataOffset);
+        m->vertices.assign(verts, verts + h.vertexCount);
+        m->indices.assign(idx, idx + h.indexCount);
+        m->lods.assign(lods, lods + h.lodCount);
+        const Tangent* tangents = (const Tangent*)(base + tangentOffset);
+        m->tangents.assign(tangents, tangents + tangentCount);
+    }
+
+    munmap(mapped, st.st_size);
+    return ok;
+}
+
+void WriteMeshCache(const Model* m, const std::string& objPath) {
+    struct stat src;
+    if (stat(objPath.c_str(), &src) != 0) return;
+
+    MeshCacheHeader h = {};
+    memcpy(h.magic, "MSHC", 4);
+    h.version = MESH_CACHE_VERSION;
+    h.sourceSize = src.st_size;
+    h.sourceMtime = src.st_mtime;
+    h.sourceHash = HashFile(objPath);
+    h.materialHash = m->materialPath.empty() ? 0 : HashFile(m->materialPath);
+    h.flags = (useIndexedMeshes ? (uint32_t)MESH_CACHE_INDEXED : 0u)
+            | (m->hasNormals ? (uint32_t)MESH_CACHE_NORMALS : 0u)
+            | (m->hasTexcoords ? (uint32_t)MESH_CACHE_TEXCOORDS : 0u)
+            | (!m->tangents.empty() ? (uint32_t)MESH_CACHE_TANGENTS : 0u)
+            | (m->normalsGenerated ? (uint32_t)MESH_CACHE_GENERATED_NORMALS : 0u)
+            | (m->normalsGenerated && normalWeighting == NORMALS_ANGLE ? (uint32_t)MESH_CACHE_ANGLE_WEIGHTED : 0u);
+    h.vertexCount = m->vertices.size();
+    h.indexCount = m->indices.size();
+    h.textureNameLength = m->textureName.size();
+    h.lodCount = m->lods.size();
+    h.materialPathLength = m->materialPath.size();
+
+    // Write to a temp file and rename so a crash never leaves a half-written cache
+    std::string cachePath = objPath + ".meshcache";
+    std::string tmpPath = cachePath + ".tmp";
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f) return;
+
+    static const char pad[4] = {0, 0, 0, 0};
+    size_t padBytes = MeshCacheDataOffset(h) - sizeof(h) - h.textureNameLength - h.materialPathLength;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+           && fwrite(m->textureName.data(), 1, h.textureNameLength, f) == h.textureNameLength
+           && fwrite(m->materialPath.data(), 1, h.materialPathLength, f) == h.materialPathLength
+           && fwrite(pad, 1, padBytes, f) == padBytes
+           && fwrite(m->vertices.data(), sizeof(Vertex), h.vertexCount, f) == h.vertexCount
+           && fwrite(m->indices.data(), sizeof(uint32_t), h.indexCount, f) == h.indexCount
+           && fwrite(m->lods.data(), sizeof(MeshLod), h.lodCount, f) == h.lodCount
+           && fwrite(m->tangents.data(), sizeof(Tangent), m->tangents.size(), f) == m->tangents.size();
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok) rename(tmpPath.c_str(), cachePath.c_str());
+    else remove(tmpPath.c_str());
+}
+
+// AABB + bounding sphere (centered on the box) in model space
+void ComputeBounds(Model* m) {
+    if (m->vertices.empty()) return;
+    for (int k = 0; k < 3; k++) {
+        m->boundsMin[k] = m->boundsMax[k] = (&m->vertices[0].px)[k];
+    }
+    for (const Vertex& v : m->vertices) {
+        const float* p = &v.px;
+        for (int k = 0; k < 3; k++) {
+            m->boundsMin[k] = std::min(m->boundsMin[k], p[k]);
+            m->boundsMax[k] = std::max(m->boundsMax[k], p[k]);
+        }
+    }
+
+    for (int k = 0; k < 3; k++) m->center[k] = 0.5f * (m->boundsMin[k] + m->boundsMax[k]);
+    float r2 = 0.0f;
+    for (const Vertex& v : m->vertices) {
+        float dx = v.px - m->center[0], dy = v.py - m->center[1], dz = v.pz - m->center[2];
+        r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+    }
+    m->radius = sqrt(r2);
+}
+
+// Rewinds the calling thread's loadArena when the import using it returns
+struct LoadArenaScope {
+    ~LoadArenaScope() { loadArena.Reset(); }
+};
+
+// Load OBJ / OFF from "models/" folder (or its binary cache)
+std::string ModelPath(const std::string& name) {
+    return "models/" + name;
+}
+
+// CPU half of a model load: mesh from the cache, OBJ or OFF. No GL calls.
+// allowCache = false always re-imports (hot reload), then refreshes the cache.
+bool LoadModelData(Model* m, std::ostringstream& log, bool allowCache = true) {
+    LoadArenaScope arenaScope;
+    std::string fullPath = ModelPath(m->name);
+    if (useMeshCache && allowCache && LoadMeshCache(m, fullPath)) {
+        log << "[cache] ";
+    } else {
+        bool imported = IsOffFile(fullPath) ? ImportOff(m, fullPath) : ImportObj(m, fullPath);
+        if (!imported) {
+            log << "FAILED!";
+            return false;
+        }
+        BuildLodChain(m);
+        if (useMeshCache) WriteMeshCache(m, fullPath);
+    }
+
+    ComputeBounds(m);
+    if (m->normalsGenerated) log << "[normals: " << (normalWeighting == NORMALS_ANGLE ? "angle" : "area") << "-weighted] ";
+    if (m->lods.size() > 1) {
+        log << "[LODs:";
+        for (const MeshLod& lod : m->lods) log << " " << lod.indexCount / 3;
+        log << " tris] ";
+    }
+
+    if (!m->textureName.empty()) log << "[Texture: " << m->textureName << "] ";
+    return true;
+}
+
+// GL half of a model load. GLUT thread only.
+void FinishModelLoad(Model* m, std::ostringstream& log) {
+    if (!m->textureName.empty()) m->texture = GetTexture(m->textureName);
+    UploadModel(m);
+    fileWatcher.Watch(m->materialPath);
+
+    m->loaded = true;
+    sceneBvhDirty = true; // Objects using it enter the scene BVH
+    staticBatchesDirty = true;
+    if (m->indices.empty()) log << "Done. (" << m->vertices.size()/3 << " tris)";
+    else log << "Done. (" << m->lods[0].indexCount/3 << " tris, " << m->vertices.size() << " unique verts)";
+    LogLine(log.str());
+}
+
+void HotReloadModel(Model* m);
+
+void OnAssetFinished() {
+    if (--pendingAssets == 0) {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - loadStartTime).count();
+        LogLine("All assets loaded in " + std::to_string(ms) + " ms");
+    }
+}
+
+// Returns immediately with an unloaded Model when async loading is on;
+// display() skips it until the upload queue marks it loaded.
+// Each call adds a reference; pair it with ReleaseModel().
+Model* GetModel(std::string filename) {
+    if (Model* m = modelRegistry.Acquire(filename)) return m;
+
+    Model* m = modelRegistry.Create(filename);
+    m->name = filename;
+    fileWatcher.Watch(ModelPath(filename));
+    if (pendingAssets++ == 0) loadStartTime = std::chrono::steady_clock::now();
+    WakeIdle(); // Keep pumping the upload queue until this lands
+
+    auto job = [m] {
+        ProfileScope scope("Load model", m->name);
+        auto log = std::make_shared<std::ostringstream>();
+        *log << "Loading Model: " << m->name << "... ";
+        bool ok = LoadModelData(m, *log);
+
+        PostToMainThread([m, log, ok] {
+            if (m->unloadRequested) modelRegistry.Destroy(m);
+            else {
+                if (ok) {
+                    ProfileScope scope("Upload model", m->name);
+                    FinishModelLoad(m, *log);
+                }
+                else { m->failed = true; LogLine(log->str()); }
+                if (m->reloadQueued) HotReloadModel(m); // Changed while it was loading
+            }
+            OnAssetFinished();
+            glutPostRedisplay();
+        });
+    };
+
+    if (useAsyncLoading) loaderPool.Submit(job);
+    else { job(); PumpUploadQueue(); }
+    return m;
+}
+
+void DestroyModel(Model* m) {
+    FreeModelBuffers(*m);
+    ReleaseTexture(m->texture);
+    modelRegistry.Destroy(m);
+}
+
+// Drops a reference; the last one frees the GPU buffers and the texture reference.
+void ReleaseModel(Model* m) {
+    if (!m || !modelRegistry.Release(m->name)) return;
+    fileWatcher.Unwatch(ModelPath(m->name));
+    if (!m->loaded && !m->failed) { m->unloadRequested = true; return; } // Load callback frees it
+    if (m->loaded) fileWatcher.Unwatch(m->materialPath); // Watched by FinishModelLoad
+    if (m->reloading) { m->unloadRequested = true; return; } // Reload callback frees it
+    DestroyModel(m);
+}
+
+void RebatchModel(const Model* m);  // Static batching (section 7)
+void FreeStaticBatches();
+void UpdateSceneBvh(const std::vector<uint32_t>& moved);
+
+// Moves freshly imported geometry into m, which keeps its identity: every object
+// drawing m switches to the new buffers together, and the old ones are deleted
+// only once the new ones are uploaded.
+void SwapInModelData(Model* m, Model& fresh) {
+    bool wasLoaded = m->loaded;
+    m->vertices.swap(fresh.vertices);
+    m->indices.swap(fresh.indices);
+    m->lods.swap(fresh.lods);
+    m->tangents.swap(fresh.tangents);
+    m->hasNormals = fresh.hasNormals;
+    m->hasTexcoords = fresh.hasTexcoords;
+    m->normalsGenerated = fresh.normalsGenerated;
+    for (int k = 0; k < 3; k++) {
+        m->boundsMin[k] = fresh.boundsMin[k];
+        m->boundsMax[k] = fresh.boundsMax[k];
+        m->center[k] = fresh.center[k];
+    }
+    m->radius = fresh.radius;
+    m->triangleBvh = Bvh(); // Rebuilt by the next pick
+
+    // The old buffers go to fresh, which frees them after the upload
+    std::swap(m->vao, fresh.vao);
+    std::swap(m->vbo, fresh.vbo);
+    std::swap(m->ibo, fresh.ibo);
+    std::swap(m->instanceVBO, fresh.instanceVBO);
+    std::swap(m->indexCount, fresh.indexCount);
+    std::swap(m->gpuBytes, fresh.gpuBytes);
+    UploadModel(m);
+    FreeModelBuffers(fresh);
+
+    if (m->materialPath != fresh.materialPath) {
+        if (wasLoaded) fileWatcher.Unwatch(m->materialPath);
+        m->materialPath = fresh.materialPath;
+        fileWatcher.Watch(m->materialPath);
+    }
+
+    // A different diffuse map: take the new one before letting go of the old, which
+    // may be the same file under another model. Batches are grouped by texture and
+    // point at it without a reference, so they go first (objects draw on their own
+    // until the rebuild, which waits for the new texture).
+    if (m->textureName != fresh.textureName) {
+        Texture* old = m->texture;
+        m->textureName = fresh.textureName;
+        m->texture = m->textureName.empty() ? nullptr : GetTexture(m->textureName);
+        FreeStaticBatches(); // Marks them dirty
+        ReleaseTexture(old);
+    }
+
+    m->loaded = true;
+    m->failed = false;
+    std::vector<uint32_t> users;
+    for (uint32_t i = 0; i < scene.Count(); i++) {
+        if (scene.model[i] == m) users.push_back(i);
+    }
+    if (wasLoaded) UpdateSceneBvh(users); // New bounds, same objects
+    else sceneBvhDirty = true;            // Failed before: its objects join the tree
+    for (uint32_t i : users) {
+        if (i < occlusion.size()) occlusion[i].occluded = false; // Re-tested with the new shape
+    }
+    RebatchModel(m);
+}
+
+// Re-imports a changed model on a loader thread, skipping the mesh cache (which it
+// rewrites), and swaps the result into m on the GLUT thread. The rest of the scene
+// is untouched, and m keeps drawing its old mesh until then. If the import fails
+// (say the file is still half-written) the old mesh stays.
+void HotReloadModel(Model* m) {
+    if ((!m->loaded && !m->failed) || m->reloading) { m->reloadQueued = true; return; }
+    m->reloading = true;
+    m->reloadQueued = false;
+    pendingReloads++; // Keeps idle() pumping until it lands
+    WakeIdle();
+
+    double start = NowSeconds();
+    auto job = [m, start] {
+        ProfileScope scope("Reload model", m->name);
+        auto fresh = std::make_shared<Model>();
+        fresh->name = m->name;
+        auto log = std::make_shared<std::ostringstream>();
+        *log << "Reloading Model: " << m->name << "... ";
+        bool ok = LoadModelData(fresh.get(), *log, false);
+
+        PostToMainThread([m, fresh, log, ok, start] {
+            m->reloading = false;
+            pendingReloads--;
+            if (m->unloadRequested) { DestroyModel(m); return; }
+            if (ok) {
+                ProfileScope scope("Upload model", m->name);
+                SwapInModelData(m, *fresh);
+                *log << "Done in " << (int)((NowSeconds() - start) * 1000.0) << " ms";
+            } else {
+                *log << " Keeping the previous mesh";
+            }
+            LogLine(log->str());
+            if (m->reloadQueued) HotReloadModel(m);
+            glutPostRedisplay();
+        });
+    };
+
+    if (useAsyncLoading) loaderPool.Submit(job);
+    else { job(); PumpUploadQueue(); }
+}
+
+// ==========================================
+// 6. SCENE SETUP
+// ==========================================
+uint32_t AddGroup(std::string name, int32_t parent = -1,
+                  float x = 0, float y = 0, float z = 0)
+{
+    uint32_t group = scene.Add(name, parent);
+    scene.posX[group] = x; scene.posY[group] = y; scene.posZ[group] = z;
+    return group;
+}
+
+uint32_t AddObj(std::string name, std::string modelName, 
+            float x, float y, float z, 
+            float rx, float ry, float rz, 
+            float sx, float sy, float sz,
+            bool isAnimated = false,
+            int32_t parent = -1) 
+{
+    uint32_t obj = scene.Add(name, parent);
+    scene.model[obj] = GetModel(modelName); 
+    
+    scene.posX[obj] = x; scene.posY[obj] = y; scene.posZ[obj] = z;
+    scene.rotX[obj] = rx; scene.rotY[obj] = ry; scene.rotZ[obj] = rz;
+    scene.sclX[obj] = sx; scene.sclY[obj] = sy; scene.sclZ[obj] = sz;
+
+    if (isAnimated) {
+        scene.spinning[obj] = 1;
+        scene.spinSpeed[obj] = CLOCK_SPIN_SPEED;
+    }
+    return obj;
+}
+
+// ------------------------------------------
+// Streaming scene.json reader
+// ------------------------------------------
+// Pull tokenizer over a small read buffer: the scene is built node by node as
+// tokens arrive (no DOM), and each "model" reference starts its load right away.
+class JsonReader {
+public:
+    enum Token { BEGIN_OBJECT, END_OBJECT, BEGIN_ARRAY, END_ARRAY, COLON, COMMA,
+                 STRING, NUMBER, VALUE_TRUE, VALUE_FALSE, VALUE_NULL, END_OF_INPUT, PARSE_ERROR };
+
+    explicit JsonReader(FILE* file) : f(file) {}
+
+    Token Next() {
+        if (failed) return PARSE_ERROR;
+        SkipWhitespace();
+        int c = Get();
+        switch (c) {
+            case EOF: return END_OF_INPUT;
+            case '{': return BEGIN_OBJECT;
+            case '}': return END_OBJECT;
+            case '[': return BEGIN_ARRAY;
+            case ']': return END_ARRAY;
+            case ':': return COLON;
+            case ',': return COMMA;
+            case '"': return ReadString() ? STRING : PARSE_ERROR;
+            case 't': return ReadLiteral("rue") ? VALUE_TRUE : PARSE_ERROR;
+            case 'f': return ReadLiteral("alse") ? VALUE_FALSE : PARSE_ERROR;
+            case 'n': return ReadLiteral("ull") ? VALUE_NULL : PARSE_ERROR;
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) return ReadNumber(c) ? NUMBER : PARSE_ERROR;
+        Fail(std::string("unexpected character '") + (char)c + "'");
+        return PARSE_ERROR;
+    }
+
+    // Consumes one complete value (used for keys the scene builder doesn't know)
+    bool SkipValue(Token t) {
+        if (t == BEGIN_OBJECT || t == BEGIN_ARRAY) {
+            int depth = 1;
+            while (depth > 0) {
+                Token n = Next();
+                if (n == BEGIN_OBJECT || n == BEGIN_ARRAY) depth++;
+                else if (n == END_OBJECT || n == END_ARRAY) depth--;
+                else if (n == END_OF_INPUT || n == PARSE_ERROR) return Fail("unterminated value");
+            }
+            return true;
+        }
+        return t == STRING || t == NUMBER || t == VALUE_TRUE || t == VALUE_FALSE || t == VALUE_NULL || Fail("expected a value");
+    }
+
+    bool Expect(Token want, const char* what) {
+        return Next() == want || Fail(std::string("expected ") + what);
+    }
+
+    // Records the first error; always returns false so callers can "return in.Fail(...)"
+    bool Fail(const std::string& msg) {
+        if (!failed) error = "line " + std::to_string(line) + ": " + msg;
+        failed = true;
+        return false;
+    }
+
+    std::string text;       // Last STRING
+    double number = 0.0;    // Last NUMBER
+    bool failed = false;
+    std::string error;
+
+private:
+    int Peek() {
+        if (pos == len) {
+            len = fread(buf, 1, sizeof(buf), f);
+            pos = 0;
+            if (len == 0) return EOF;
+        }
+        return (unsigned char)buf[pos];
+    }
+
+    int Get() {
+        int c = Peek();
+        if (c != EOF) pos++;
+        if (c == '\n') line++;
+        return c;
+    }
+
+    void SkipWhitespace() {
+        for (int c = Peek(); c == ' ' || c == '\t' || c == '\n' || c == '\r'; c = Peek()) Get();
+    }
+
+    bool ReadLiteral(const char* rest) {
+        for (; *rest; rest++) {
+            if (Get() != *rest) return Fail("bad literal");
+        }
+        return true;
+    }
+
+    bool ReadNumber(int first) {
+        char tmp[64];
+        size_t n = 0;
+        tmp[n++] = (char)first;
+        for (int c = Peek(); (c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-'; c = Peek()) {
+            if (n + 1 >= sizeof(tmp)) return Fail("number too long");
+            tmp[n++] = (char)Get();
+        }
+        tmp[n] = 0;
+        char* endp = nullptr;
+        number = strtod(tmp, &endp);
+        return *endp == 0 || Fail("bad number");
+    }
+
+    void AppendUtf8(unsigned int cp) {
+        if (cp < 0x80) text += (char)cp;
+        else if (cp < 0x800) { text += (char)(0xC0 | (cp >> 6)); text += (char)(0x80 | (cp & 0x3F)); }
+        else if (cp < 0x10000) { text += (char)(0xE0 | (cp >> 12)); text += (char)(0x80 | ((cp >> 6) & 0x3F)); text += (char)(0x80 | (cp & 0x3F)); }
+        else { text += (char)(0xF0 | (cp >> 18)); text += (char)(0x80 | ((cp >> 12) & 0x3F)); text += (char)(0x80 | ((cp >> 6) & 0x3F)); text += (char)(0x80 | (cp & 0x3F)); }
+    }
+
+    bool ReadHex4(unsigned int& out) {
+        out = 0;
+        for (int i = 0; i < 4; i++) {
+            int c = Get();
+            out <<= 4;
+            if (c >= '0' && c <= '9') out |= c - '0';
+            else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool ReadString() {
+        text.clear();
+        for (;;) {
+            int c = Get();
+            if (c == EOF || c == '\n') return Fail("unterminated string");
+            if (c == '"') return true;
+            if (c != '\\') { text += (char)c; continue; }
+
+            c = Get();
+            switch (c) {
+                case '"': case '\\': case '/': text += (char)c; break;
+                case 'b': text += '\b'; break;
+                case 'f': text += '\f'; break;
+                case 'n': text += '\n'; break;
+                case 'r': text += '\r'; break;
+                case 't': text += '\t'; break;
+                case 'u': {
+                    unsigned int cp;
+                    if (!ReadHex4(cp)) return Fail("bad \\u escape");
+                    if (cp >= 0xD800 && cp < 0xDC00) { // Surrogate pair
+                        unsigned int lo;
+                        if (Get() != '\\' || Get() != 'u' || !ReadHex4(lo) || lo < 0xDC00 || lo >= 0xE000) return Fail("bad surrogate pair");
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    } else if (cp >= 0xDC00 && cp < 0xE000) {
+                        return Fail("unpaired low surrogate");
+                    }
+                    AppendUtf8(cp);
+                    break;
+                }
+                default: return Fail("bad escape");
+            }
+        }
+    }
+
+    FILE* f;
+    char buf[16 * 1024];
+    size_t pos = 0, len = 0;
+    int line = 1;
+};
+
+// Walks "key": value pairs of the object whose '{' was just read.
+// onKey returns false on a parse error.
+bool ReadObjectFields(JsonReader& in, const std::function<bool(const std::string&, JsonReader::Token)>& onKey) {
+    JsonReader::Token t = in.Next();
+    if (t == JsonReader::END_OBJECT) return true;
+    for (;;) {
+        if (t != JsonReader::STRING) return in.Fail("expected a key");
+        std::string key = in.text;
+        if (!in.Expect(JsonReader::COLON, "':'")) return false;
+        if (!onKey(key, in.Next())) return false;
+
+        t = in.Next();
+        if (t == JsonReader::END_OBJECT) return true;
+        if (t != JsonReader::COMMA) return in.Fail("expected ',' or '}'");
+        t = in.Next();
+    }
+}
+
+bool ReadVec3(JsonReader& in, JsonReader::Token t, float out[3]) {
+    if (t != JsonReader::BEGIN_ARRAY) return in.Fail("expected [x, y, z]");
+    for (int i = 0; i < 3; i++) {
+        if (i > 0 && !in.Expect(JsonReader::COMMA, "','")) return false;
+        if (in.Next() != JsonReader::NUMBER) return in.Fail("expected a number");
+        out[i] = in.number;
+    }
+    return in.Expect(JsonReader::END_ARRAY, "']'");
+}
+
+bool ReadNodeArray(JsonReader& in, JsonReader::Token t, int32_t parent);
+
+// "light": {"color", "offset", "attenuation"}, all optional [x, y, z] arrays
+bool ReadLight(JsonReader& in, JsonReader::Token t, uint32_t node) {
+    if (t != JsonReader::BEGIN_OBJECT) return in.Fail("expected light object");
+    SceneLight light;
+    light.node = scene.HandleOf(node);
+    bool ok = ReadObjectFields(in, [&](const std::string& key, JsonReader::Token t) {
+        if (key == "color") return ReadVec3(in, t, light.color);
+        if (key == "offset") return ReadVec3(in, t, light.offset);
+        if (key == "attenuation") return ReadVec3(in, t, light.attenuation);
+        return in.SkipValue(t);
+    });
+    sceneLights.push_back(light);
+    lightsVersion++;
+    return ok;
+}
+
+// One node: {"name", "type", "model", "pos", "rot", "scale", "isAnimated", "speed", "light", "children"}
+bool ReadNode(JsonReader& in, int32_t parent) {
+    // Children are appended after this node, so indices (not references) are held across the parse
+    uint32_t n = scene.Add("Unnamed", parent);
+
+    std::string type = "group";
+    bool ok = ReadObjectFields(in, [&](const std::string& key, JsonReader::Token t) {
+        if (key == "name" && t == JsonReader::STRING) scene.name[n] = in.text;
+        else if (key == "type" && t == JsonReader::STRING) type = in.text;
+        else if (key == "model" && t == JsonReader::STRING) {
+            ReleaseModel(scene.model[n]);
+            scene.model[n] = GetModel(in.text); // Load starts now, while the rest of the file is parsed
+        }
+        else if (key == "pos") { float v[3]; if (!ReadVec3(in, t, v)) return false; scene.posX[n] = v[0]; scene.posY[n] = v[1]; scene.posZ[n] = v[2]; }
+        else if (key == "rot") { float v[3]; if (!ReadVec3(in, t, v)) return false; scene.rotX[n] = v[0]; scene.rotY[n] = v[1]; scene.rotZ[n] = v[2]; }
+        else if (key == "scale") { float v[3]; if (!ReadVec3(in, t, v)) return false; scene.sclX[n] = v[0]; scene.sclY[n] = v[1]; scene.sclZ[n] = v[2]; }
+        else if (key == "isAnimated" && (t == JsonReader::VALUE_TRUE || t == JsonReader::VALUE_FALSE)) scene.spinning[n] = (t == JsonReader::VALUE_TRUE);
+        else if (key == "speed" && t == JsonReader::NUMBER) scene.spinSpeed[n] = in.number;
+        else if (key == "light") return ReadLight(in, t, n);
+        else if (key == "children") return ReadNodeArray(in, t, n);
+        else return in.SkipValue(t);
+        return true;
+    });
+
+    // Only meshes draw a model (complex1 rule); animated nodes default to the clock speed
+    if (type != "mesh" && scene.model[n]) { ReleaseModel(scene.model[n]); scene.model[n] = nullptr; }
+    if (scene.spinning[n] && scene.spinSpeed[n] == 0.0f) scene.spinSpeed[n] = CLOCK_SPIN_SPEED;
+    return ok;
+}
+
+bool ReadNodeArray(JsonReader& in, JsonReader::Token t, int32_t parent) {
+    if (t != JsonReader::BEGIN_ARRAY) return in.Fail("expected an array of nodes");
+    t = in.Next();
+    if (t == JsonReader::END_ARRAY) return true;
+    for (;;) {
+        if (t != JsonReader::BEGIN_OBJECT) return in.Fail("expected a node object");
+        if (!ReadNode(in, parent)) return false;
+
+        t = in.Next();
+        if (t == JsonReader::END_ARRAY) return true;
+        if (t != JsonReader::COMMA) return in.Fail("expected ',' or ']'");
+        t = in.Next();
+    }
+}
+
+// "camera": {"pos": [x, y, z]} -> orbit parameters (the orbit always looks at the origin)
+bool ReadCamera(JsonReader& in, JsonReader::Token t) {
+    if (t != JsonReader::BEGIN_OBJECT) return in.Fail("expected camera object");
+    return ReadObjectFields(in, [&](const std::string& key, JsonReader::Token t) {
+        if (key != "pos") return in.SkipValue(t);
+        float p[3];
+        if (!ReadVec3(in, t, p)) return false;
+        cameraDist = sqrt(p[0] * p[0] + p[1] * p[1]);
+        cameraAngle = atan2(p[0], p[1]);
+        cameraHeight = p[2];
+        return true;
+    });
+}
+
+// ------------------------------------------
+// Binary scene (".scnb")
+// ------------------------------------------
+// Layout: header | SceneNodeRecord[nodeCount] | SceneStringRef[modelCount] | string bytes
+// Nodes are stored depth-first so every parent index is smaller than its child's.
+// Loading maps the file and copies records straight into Objects (no text parsing).
+const uint32_t SCENE_BINARY_VERSION = 2; // 2: light table
+
+struct SceneBinaryHeader {
+    char magic[4];          // "SCNB"
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t modelCount;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    float cameraAngle, cameraHeight, cameraDist;
+    uint32_t lightCount;
+};
+
+struct SceneStringRef {
+    uint32_t offset, length;    // Into the string bytes
+};
+
+enum SceneNodeFlags : uint32_t {
+    SCENE_NODE_SPIN = 1 << 0,
+};
+
+// Layout: header, node records, model names, light records, string bytes
+struct SceneLightRecord {
+    int32_t node;           // Node index the light follows
+    float color[3];
+    float offset[3];
+    float attenuation[3];
+};
+
+struct SceneNodeRecord {
+    float pos[3], rot[3], scale[3];
+    float spinSpeed;
+    int32_t parent;         // Node index, -1 = root
+    int32_t model;          // Model table index, -1 = group
+    SceneStringRef name;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+std::string currentScenePath = "scene.json";
+
+bool SaveSceneBinary(const std::string& path) {
+    std::unordered_map<const Model*, int32_t> modelIndex;
+    std::vector<SceneNodeRecord> nodes;
+    std::vector<SceneStringRef> models;
+    std::string strings;
+
+    auto addString = [&](const std::string& str) {
+        SceneStringRef ref = { (uint32_t)strings.size(), (uint32_t)str.size() };
+        strings += str;
+        return ref;
+    };
+
+    // LoadScene() left the store depth-first, so node indices carry over as-is
+    for (uint32_t i = 0; i < scene.Count(); i++) {
+        SceneNodeRecord r = {};
+        r.pos[0] = scene.posX[i];   r.pos[1] = scene.posY[i];   r.pos[2] = scene.posZ[i];
+        r.rot[0] = scene.rotX[i];   r.rot[1] = scene.rotY[i];   r.rot[2] = scene.rotZ[i];
+        r.scale[0] = scene.sclX[i]; r.scale[1] = scene.sclY[i]; r.scale[2] = scene.sclZ[i];
+        r.spinSpeed = scene.spinSpeed[i];
+        r.flags = scene.spinning[i] ? (uint32_t)SCENE_NODE_SPIN : 0u;
+        r.parent = scene.parent[i];
+        r.model = -1;
+        if (Model* m = scene.model[i]) {
+            auto ins = modelIndex.emplace(m, (int32_t)models.size());
+            if (ins.second) models.push_back(addString(m->name));
+            r.model = ins.first->second;
+        }
+        r.name = addString(scene.name[i]);
+        nodes.push_back(r);
+    }
+
+    std::vector<SceneLightRecord> lights;
+    for (const SceneLight& light : sceneLights) {
+        int32_t node = scene.IndexOf(light.node);
+        if (node < 0) continue;
+        SceneLightRecord r;
+        r.node = node;
+        memcpy(r.color, light.color, sizeof(r.color));
+        memcpy(r.offset, light.offset, sizeof(r.offset));
+        memcpy(r.attenuation, light.attenuation, sizeof(r.attenuation));
+        lights.push_back(r);
+    }
+
+    SceneBinaryHeader h = {};
+    memcpy(h.magic, "SCNB", 4);
+    h.version = SCENE_BINARY_VERSION;
+    h.nodeCount = nodes.size();
+    h.modelCount = models.size();
+    h.lightCount = lights.size();
+    h.stringsOffset = sizeof(h) + nodes.size() * sizeof(SceneNodeRecord) + models.size() * sizeof(SceneStringRef)
+                    + lights.size() * sizeof(SceneLightRecord);
+    h.stringsSize = strings.size();
+    h.cameraAngle = cameraAngle;
+    h.cameraHeight = cameraHeight;
+    h.cameraDist = cameraDist;
+
+    // Temp file + rename, same as the mesh cache
+    std::string tmpPath = path + ".tmp";
+    FILE* f = fopen(tmpPath.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+           && fwrite(nodes.data(), sizeof(SceneNodeRecord), nodes.size(), f) == nodes.size()
+           && fwrite(models.data(), sizeof(SceneStringRef), models.size(), f) == models.size()
+           && fwrite(lights.data(), sizeof(SceneLightRecord), lights.size(), f) == lights.size()
+           && fwrite(strings.data(), 1, strings.size(), f) == strings.size();
+    ok = (fclose(f) == 0) && ok;
+    if (ok) ok = rename(tmpPath.c_str(), path.c_str()) == 0;
+    else remove(tmpPath.c_str());
+
+    std::cout << (ok ? "Saved scene: " : "Failed to save scene: ") << path << " (" << nodes.size() << " nodes)" << std::endl;
+    return ok;
+}
+
+bool LoadSceneBinary(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) { std::cerr << "No " << path << " found!\n"; return false; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SceneBinaryHeader)) { close(fd); return false; }
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+
+    const char* base = (const char*)mapped;
+    const SceneBinaryHeader* h = (const SceneBinaryHeader*)base;
+    const SceneNodeRecord* nodes = (const SceneNodeRecord*)(base + sizeof(SceneBinaryHeader));
+    const SceneStringRef* models = (const SceneStringRef*)(nodes + h->nodeCount);
+    const SceneLightRecord* lights = (const SceneLightRecord*)(models + h->modelCount);
+    const char* strings = base + h->stringsOffset;
+
+    size_t tablesEnd = sizeof(SceneBinaryHeader) + (size_t)h->nodeCount * sizeof(SceneNodeRecord) + (size_t)h->modelCount * sizeof(SceneStringRef)
+                     + (size_t)h->lightCount * sizeof(SceneLightRecord);
+    bool ok = memcmp(h->magic, "SCNB", 4) == 0 && h->version == SCENE_BINARY_VERSION
+           && h->stringsOffset == tablesEnd && h->stringsOffset + h->stringsSize == (uint64_t)st.st_size;
+
+    auto inStrings = [&](const SceneStringRef& ref) { return (uint64_t)ref.offset + ref.length <= h->stringsSize; };
+    for (uint32_t i = 0; ok && i < h->modelCount; i++) ok = inStrings(models[i]);
+
+    if (!ok) {
+        std::cerr << "Bad or outdated binary scene: " << path << "\n";
+        munmap(mapped, st.st_size);
+        return false;
+    }
+
+    // Resolve the model table once; nodes referencing the same model then just add a reference
+    std::vector<std::string> modelNames(h->modelCount);
+    for (uint32_t i = 0; i < h->modelCount; i++) modelNames[i].assign(strings + models[i].offset, models[i].length);
+
+    // File indices are relative to this file; offset them past any nodes already in the store
+    int32_t first = scene.Count();
+    for (uint32_t i = 0; i < h->nodeCount; i++) {
+        const SceneNodeRecord& r = nodes[i];
+        if (!inStrings(r.name) || r.parent >= (int32_t)i || r.model >= (int32_t)h->modelCount) { ok = false; break; }
+
+        uint32_t n = scene.Add(std::string(strings + r.name.offset, r.name.length), r.parent >= 0 ? first + r.parent : -1);
+        scene.posX[n] = r.pos[0];   scene.posY[n] = r.pos[1];   scene.posZ[n] = r.pos[2];
+        scene.rotX[n] = r.rot[0];   scene.rotY[n] = r.rot[1];   scene.rotZ[n] = r.rot[2];
+        scene.sclX[n] = r.scale[0]; scene.sclY[n] = r.scale[1]; scene.sclZ[n] = r.scale[2];
+        scene.spinning[n] = (r.flags & SCENE_NODE_SPIN) != 0;
+        scene.spinSpeed[n] = r.spinSpeed;
+        if (r.model >= 0) scene.model[n] = GetModel(modelNames[r.model]);
+    }
+
+    for (uint32_t i = 0; ok && i < h->lightCount; i++) {
+        const SceneLightRecord& r = lights[i];
+        if (r.node < 0 || first + r.node >= (int32_t)scene.Count()) { ok = false; break; }
+        SceneLight light;
+        light.node = scene.HandleOf(first + r.node);
+        memcpy(light.color, r.color, sizeof(r.color));
+        memcpy(light.offset, r.offset, sizeof(r.offset));
+        memcpy(light.attenuation, r.attenuation, sizeof(r.attenuation));
+        sceneLights.push_back(light);
+        lightsVersion++;
+    }
+
+    cameraAngle = h->cameraAngle;
+    cameraHeight = h->cameraHeight;
+    cameraDist = h->cameraDist;
+
+    munmap(mapped, st.st_size);
+    if (!ok) std::cerr << "Corrupt node or light table in " << path << ", keeping what was read\n";
+    return ok;
+}
+
+bool LoadSceneJson(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) { std::cerr << "No " << path << " found!\n"; return false; }
+
+    JsonReader in(f);
+    bool ok = in.Expect(JsonReader::BEGIN_OBJECT, "'{'") && ReadObjectFields(in, [&](const std::string& key, JsonReader::Token t) {
+        if (key == "camera") return ReadCamera(in, t);
+        if (key == "root") return ReadNodeArray(in, t, -1);
+        return in.SkipValue(t);
+    });
+    fclose(f);
+
+    if (!ok) std::cerr << "Scene parse error in " << path << " (" << in.error << "), keeping what was read\n";
+    return ok;
+}
+
+void ResetOcclusion(); // Rendering (below)
+void FreeStaticBatches();
+
+// ".scnb" -> binary snapshot, anything else -> JSON
+bool LoadScene(const std::string& path) {
+    currentScenePath = path;
+    bool isBinary = path.size() >= 5 && path.compare(path.size() - 5, 5, ".scnb") == 0;
+    bool ok = isBinary ? LoadSceneBinary(path) : LoadSceneJson(path);
+
+    scene.Finalize();
+    sceneBvhDirty = true;
+    ResetOcclusion();
+    FreeStaticBatches(); // Stale node indices; rebuilt once the new assets are in
+    if ((int)sceneLights.size() > MAX_SHADER_LIGHTS || (int)sceneLights.size() >= maxFixedLights) {
+        std::cout << "Lights: " << sceneLights.size() << " in scene; clustered path uses " << MAX_CLUSTERED_LIGHTS
+                  << ", per-vertex instanced " << MAX_SHADER_LIGHTS << ", fixed-function " << maxFixedLights - 1 << std::endl;
+    }
+
+    // Set default selection to the first object
+    if(scene.Count() > 0) {
+        selectedObject = scene.HandleOf(0); 
+        selectionIndex = 0;
+        selectionTime = NowSeconds();
+    }
+    return ok;
+}
+
+// Removes every object and releases the models/textures they referenced.
+void UnloadScene() {
+    FreeStaticBatches(); // Before their textures go
+    for (Model* m : scene.model) ReleaseModel(m);
+    scene.Clear();
+    sceneLights.clear();
+    lightsVersion++;
+    visibleObjects.clear();
+    sceneBvhDirty = true;
+    ResetOcclusion();
+    profiler.ClearLoads();
+    selectedObject = ObjectHandle();
+    selectionIndex = 0;
+#ifdef __GLIBC__
+    malloc_trim(0); // Return the freed mesh / texture memory to the OS instead of holding it for the next scene
+#endif
+}
+
+// Unloads and reloads the current scene from disk (assets it shares with itself included)
+bool ReloadScene() {
+    std::string path = currentScenePath;
+    UnloadScene();
+    bool ok = LoadScene(path);
+    std::cout << "Reloaded " << path << (ok ? "" : " (with errors)") << ": " << modelRegistry.Live() << " models, "
+              << textureRegistry.Live() << " textures live" << std::endl;
+    return ok;
+}
+
+// Runs on the GLUT thread for each change the watcher posts: re-imports the models
+// and re-decodes the textures built from that file. An MTL reloads every model using it.
+void OnWatchedFileChanged(const std::string& path) {
+    std::vector<Model*> models;
+    std::vector<Texture*> textures;
+    modelRegistry.ForEach([&](Model* m) {
+        if (ModelPath(m->name) == path || (m->loaded && m->materialPath == path)) models.push_back(m);
+    });
+    textureRegistry.ForEach([&](Texture* t) {
+        std::string image = TexturePath(t->name);
+        if (image == path || (useCompressedTextures && KtxPath(image) == path)) textures.push_back(t);
+    });
+    if (models.empty() && textures.empty()) return;
+
+    LogLine("Changed: " + path);
+    for (Model* m : models) HotReloadModel(m);
+    for (Texture* t : textures) HotReloadTexture(t);
+}
+
+// GLUT sleeps while nothing animates; this wakes idle() once the watcher has posted a change
+void HotReloadTimer(int) {
+    if (hotReloadPosted.exchange(false)) WakeIdle();
+    glutTimerFunc(HOT_RELOAD_WAKE_MS, HotReloadTimer, 0);
+}
+
+void StartHotReload() {
+    fileWatcher.Start([](const std::string& path) {
+        PostToMainThread([path] { OnWatchedFileChanged(path); });
+        hotReloadPosted = true;
+    });
+    glutTimerFunc(HOT_RELOAD_WAKE_MS, HotReloadTimer, 0);
+}
+
+// ==========================================
+// 7. RENDERING
+// ==========================================
+// Same matrix as glTranslate * glRotate(X) * glRotate(Y) * glRotate(Z) * glScale
+void BuildModelMatrix(uint32_t i, float m[16]) {
+    const float d2r = 3.14159265f / 180.0f;
+    float cx = cos(scene.rotX[i] * d2r), sx = sin(scene.rotX[i] * d2r);
+    float cy = cos(scene.rotY[i] * d2r), sy = sin(scene.rotY[i] * d2r);
+    float cz = cos(scene.rotZ[i] * d2r), sz = sin(scene.rotZ[i] * d2r);
+    float kx = scene.sclX[i], ky = scene.sclY[i], kz = scene.sclZ[i];
+
+    // Column 0..2 = rotation columns scaled by kx/ky/kz, column 3 = translation
+    m[0] = cy * cz * kx;                    m[4] = -cy * sz * ky;                   m[8]  = sy * kz;        m[12] = scene.posX[i];
+    m[1] = (sx * sy * cz + cx * sz) * kx;   m[5] = (cx * cz - sx * sy * sz) * ky;   m[9]  = -sx * cy * kz;  m[13] = scene.posY[i];
+    m[2] = (sx * sz - cx * sy * cz) * kx;   m[6] = (cx * sy * sz + sx * cz) * ky;   m[10] = cx * cy * kz;   m[14] = scene.posZ[i];
+    m[3] = 0;                               m[7] = 0;                               m[11] = 0;              m[15] = 1;
+}
+
+// out = a * b (column-major, out may not alias a or b)
+void MultiplyMatrix(const float a[16], const float b[16], float out[16]) {
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            out[col * 4 + row] = a[0 * 4 + row] * b[col * 4 + 0] + a[1 * 4 + row] * b[col * 4 + 1]
+                               + a[2 * 4 + row] * b[col * 4 + 2] + a[3 * 4 + row] * b[col * 4 + 3];
+        }
+    }
+}
+
+// ------------------------------------------
+// SIMD transform kernel
+// ------------------------------------------
+// A handful of vector ops over SIMD_WIDTH floats, so the kernels below are
+// written once for AVX (8 lanes), SSE2 / NEON (4 lanes) or plain floats (1 lane).
+#if defined(__AVX__)
+typedef __m256 VFloat;
+const int SIMD_WIDTH = 8;
+const char* SIMD_NAME = "AVX";
+inline VFloat VSet(float x) { return _mm256_set1_ps(x); }
+inline VFloat VLoad(const float* p) { return _mm256_loadu_ps(p); }
+inline void VStore(float* p, VFloat v) { _mm256_storeu_ps(p, v); }
+inline VFloat VAdd(VFloat a, VFloat b) { return _mm256_add_ps(a, b); }
+inline VFloat VSub(VFloat a, VFloat b) { return _mm256_sub_ps(a, b); }
+inline VFloat VMul(VFloat a, VFloat b) { return _mm256_mul_ps(a, b); }
+inline VFloat VDiv(VFloat a, VFloat b) { return _mm256_div_ps(a, b); }
+inline VFloat VSqrt(VFloat v) { return _mm256_sqrt_ps(v); }
+inline VFloat VMin(VFloat a, VFloat b) { return _mm256_min_ps(a, b); }
+inline VFloat VMax(VFloat a, VFloat b) { return _mm256_max_ps(a, b); }
+inline VFloat VFloor(VFloat v) { return _mm256_floor_ps(v); }
+inline VFloat VGather(const float* base, const uint32_t* ix) {
+    return _mm256_setr_ps(base[ix[0]], base[ix[1]], base[ix[2]], base[ix[3]], base[ix[4]], base[ix[5]], base[ix[6]], base[ix[7]]);
+}
+// 0/1 bytes -> 0.0f/1.0f
+inline VFloat VLoadFlags(const uint8_t* p) {
+    __m128i bytes = _mm_loadl_epi64((const __m128i*)p);
+    __m128i lo = _mm_cvtepu8_epi32(bytes);
+    __m128i hi = _mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4));
+    return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+}
+#elif defined(__SSE2__)
+typedef __m128 VFloat;
+const int SIMD_WIDTH = 4;
+const char* SIMD_NAME = "SSE2";
+inline VFloat VSet(float x) { return _mm_set1_ps(x); }
+inline VFloat VLoad(const float* p) { return _mm_loadu_ps(p); }
+inline void VStore(float* p, VFloat v) { _mm_storeu_ps(p, v); }
+inline VFloat VAdd(VFloat a, VFloat b) { return _mm_add_ps(a, b); }
+inline VFloat VSub(VFloat a, VFloat b) { return _mm_sub_ps(a, b); }
+inline VFloat VMul(VFloat a, VFloat b) { return _mm_mul_ps(a, b); }
+inline VFloat VDiv(VFloat a, VFloat b) { return _mm_div_ps(a, b); }
+inline VFloat VSqrt(VFloat v) { return _mm_sqrt_ps(v); }
+inline VFloat VMin(VFloat a, VFloat b) { return _mm_min_ps(a, b); }
+inline VFloat VMax(VFloat a, VFloat b) { return _mm_max_ps(a, b); }
+inline VFloat VFloor(VFloat v) {
+    VFloat t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v)); // Truncate, then step down for negatives
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+}
+inline VFloat VGather(const float* base, const uint32_t* ix) {
+    return _mm_setr_ps(base[ix[0]], base[ix[1]], base[ix[2]], base[ix[3]]);
+}
+inline VFloat VLoadFlags(const uint8_t* p) {
+    int32_t word;
+    memcpy(&word, p, 4);
+    __m128i zero = _mm_setzero_si128();
+    __m128i bytes = _mm_cvtsi32_si128(word);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+}
+#elif defined(__ARM_NEON)
+typedef float32x4_t VFloat;
+const int SIMD_WIDTH = 4;
+const char* SIMD_NAME = "NEON";
+inline VFloat VSet(float x) { return vdupq_n_f32(x); }
+inline VFloat VLoad(const float* p) { return vld1q_f32(p); }
+inline void VStore(float* p, VFloat v) { vst1q_f32(p, v); }
+inline VFloat VAdd(VFloat a, VFloat b) { return vaddq_f32(a, b); }
+inline VFloat VSub(VFloat a, VFloat b) { return vsubq_f32(a, b); }
+inline VFloat VMul(VFloat a, VFloat b) { return vmulq_f32(a, b); }
+#if defined(__aarch64__)
+inline VFloat VDiv(VFloat a, VFloat b) { return vdivq_f32(a, b); }
+inline VFloat VSqrt(VFloat v) { return vsqrtq_f32(v); }
+#else
+// ARMv7 NEON has no exact divide / square root: go per lane
+inline VFloat VDiv(VFloat a, VFloat b) {
+    float x[4], y[4];
+    vst1q_f32(x, a);
+    vst1q_f32(y, b);
+    for (int k = 0; k < 4; k++) x[k] /= y[k];
+    return vld1q_f32(x);
+}
+inline VFloat VSqrt(VFloat v) {
+    float x[4];
+    vst1q_f32(x, v);
+    for (int k = 0; k < 4; k++) x[k] = sqrtf(x[k]);
+    return vld1q_f32(x);
+}
+#endif
+inline VFloat VMin(VFloat a, VFloat b) { return vminq_f32(a, b); }
+inline VFloat VMax(VFloat a, VFloat b) { return vmaxq_f32(a, b); }
+inline VFloat VFloor(VFloat v) {
+    VFloat t = vcvtq_f32_s32(vcvtq_s32_f32(v)); // Truncate, then step down for negatives
+    uint32x4_t stepDown = vandq_u32(vcgtq_f32(t, v), vreinterpretq_u32_f32(vdupq_n_f32(1.0f)));
+    return vsubq_f32(t, vreinterpretq_f32_u32(stepDown));
+}
+inline VFloat VGather(const float* base, const uint32_t* ix) {
+    float lanes[4] = { base[ix[0]], base[ix[1]], base[ix[2]], base[ix[3]] };
+    return vld1q_f32(lanes);
+}
+inline VFloat VLoadFlags(const uint8_t* p) {
+    uint32_t word;
+    memcpy(&word, p, 4);
+    uint8x8_t bytes = vreinterpret_u8_u32(vdup_n_u32(word));
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(bytes))));
+}
+#else
+typedef float VFloat;
+const int SIMD_WIDTH = 1;
+const char* SIMD_NAME = "scalar";
+inline VFloat VSet(float x) { return x; }
+inline VFloat VLoad(const float* p) { return *p; }
+inline void VStore(float* p, VFloat v) { *p = v; }
+inline VFloat VAdd(VFloat a, VFloat b) { return a + b; }
+inline VFloat VSub(VFloat a, VFloat b) { return a - b; }
+inline VFloat VMul(VFloat a, VFloat b) { return a * b; }
+inline VFloat VDiv(VFloat a, VFloat b) { return a / b; }
+inline VFloat VSqrt(VFloat v) { return sqrtf(v); }
+inline VFloat VMin(VFloat a, VFloat b) { return std::min(a, b); }
+inline VFloat VMax(VFloat a, VFloat b) { return std::max(a, b); }
+inline VFloat VFloor(VFloat v) { return floorf(v); }
+inline VFloat VGather(const float* base, const uint32_t* ix) { return base[ix[0]]; }
+inline VFloat VLoadFlags(const uint8_t* p) { return *p; }
+#endif
+
+// a * (1 - t) + b * t for t in {0, 1}; exact, unlike a + t * (b - a)
+inline VFloat VSelect(VFloat a, VFloat b, VFloat t) {
+    return VAdd(VMul(a, VSub(VSet(1.0f), t)), VMul(b, t));
+}
+
+// sin/cos of x (radians): Cody-Waite reduction to [-pi/4, pi/4], Cephes polynomials.
+// Quadrant fix-ups are done with multiplies so the same code runs on every lane type.
+inline void VSinCos(VFloat x, VFloat& s, VFloat& c) {
+    VFloat j = VFloor(VAdd(VMul(x, VSet(0.636619772f)), VSet(0.5f))); // Nearest multiple of pi/2
+    VFloat r = VSub(x, VMul(j, VSet(1.5703125f)));
+    r = VSub(r, VMul(j, VSet(4.837512969970703125e-4f)));
+    r = VSub(r, VMul(j, VSet(7.54978995489188216e-8f)));
+    VFloat r2 = VMul(r, r);
+
+    VFloat ps = VAdd(VMul(r2, VSet(-1.9515295891e-4f)), VSet(8.3321608736e-3f));
+    ps = VAdd(VMul(ps, r2), VSet(-1.6666654611e-1f));
+    ps = VAdd(VMul(VMul(ps, r2), r), r);
+
+    VFloat pc = VAdd(VMul(r2, VSet(2.443315711809948e-5f)), VSet(-1.388731625493765e-3f));
+    pc = VAdd(VMul(pc, r2), VSet(4.166664568298827e-2f));
+    pc = VAdd(VMul(VMul(pc, r2), r2), VSub(VSet(1.0f), VMul(r2, VSet(0.5f))));
+
+    // q = j mod 4: odd quadrants swap sin/cos, sin flips in q 2-3, cos flips in q 1-2
+    VFloat q = VSub(j, VMul(VSet(4.0f), VFloor(VMul(j, VSet(0.25f)))));
+    VFloat half = VFloor(VMul(q, VSet(0.5f)));
+    VFloat odd = VSub(q, VMul(half, VSet(2.0f)));
+    VFloat q1 = VAdd(q, VSet(1.0f));
+    q1 = VSub(q1, VMul(VSet(4.0f), VFloor(VMul(q1, VSet(0.25f)))));
+    VFloat cosHalf = VFloor(VMul(q1, VSet(0.5f)));
+
+    s = VMul(VSelect(ps, pc, odd), VSub(VSet(1.0f), VMul(half, VSet(2.0f))));
+    c = VMul(VSelect(pc, ps, odd), VSub(VSet(1.0f), VMul(cosHalf, VSet(2.0f))));
+}
+
+// Scalar reference: local matrices for nodes idx[0..count) into out[0..count)
+void BuildLocalMatricesScalar(const uint32_t* idx, uint32_t count, Matrix4* out) {
+    for (uint32_t k = 0; k < count; k++) BuildModelMatrix(idx[k], out[k].m);
+}
+
+// Same result as the scalar path, SIMD_WIDTH nodes per step (idx must be ascending).
+// Runs of consecutive indices load straight from the SoA arrays; the rest gather.
+void BuildLocalMatricesSimd(const uint32_t* idx, uint32_t count, Matrix4* out) {
+    const float d2r = 3.14159265f / 180.0f;
+    uint32_t k = 0;
+    for (; k + SIMD_WIDTH <= count; k += SIMD_WIDTH) {
+        const uint32_t* ix = idx + k;
+        bool contiguous = ix[SIMD_WIDTH - 1] - ix[0] == (uint32_t)SIMD_WIDTH - 1;
+        auto fetch = [&](const std::vector<float>& a) { return contiguous ? VLoad(&a[ix[0]]) : VGather(a.data(), ix); };
+
+        VFloat sx, cx, sy, cy, sz, cz;
+        VSinCos(VMul(fetch(scene.rotX), VSet(d2r)), sx, cx);
+        VSinCos(VMul(fetch(scene.rotY), VSet(d2r)), sy, cy);
+        VSinCos(VMul(fetch(scene.rotZ), VSet(d2r)), sz, cz);
+        VFloat kx = fetch(scene.sclX), ky = fetch(scene.sclY), kz = fetch(scene.sclZ);
+
+        // Same terms as BuildModelMatrix, one lane per node; lanes[e] holds element e of every matrix
+        VFloat sxsy = VMul(sx, sy), cxsy = VMul(cx, sy);
+        float lanes[16][SIMD_WIDTH];
+        VStore(lanes[0], VMul(VMul(cy, cz), kx));
+        VStore(lanes[1], VMul(VAdd(VMul(sxsy, cz), VMul(cx, sz)), kx));
+        VStore(lanes[2], VMul(VSub(VMul(sx, sz), VMul(cxsy, cz)), kx));
+        VStore(lanes[4], VMul(VSub(VSet(0.0f), VMul(cy, sz)), ky));
+        VStore(lanes[5], VMul(VSub(VMul(cx, cz), VMul(sxsy, sz)), ky));
+        VStore(lanes[6], VMul(VAdd(VMul(cxsy, sz), VMul(sx, cz)), ky));
+        VStore(lanes[8], VMul(sy, kz));
+        VStore(lanes[9], VMul(VSub(VSet(0.0f), VMul(sx, cy)), kz));
+        VStore(lanes[10], VMul(VMul(cx, cy), kz));
+        VStore(lanes[12], fetch(scene.posX));
+        VStore(lanes[13], fetch(scene.posY));
+        VStore(lanes[14], fetch(scene.posZ));
+
+        for (int l = 0; l < SIMD_WIDTH; l++) {
+            float* m = out[k + l].m;
+            m[0] = lanes[0][l];  m[4] = lanes[4][l];  m[8]  = lanes[8][l];   m[12] = lanes[12][l];
+            m[1] = lanes[1][l];  m[5] = lanes[5][l];  m[9]  = lanes[9][l];   m[13] = lanes[13][l];
+            m[2] = lanes[2][l];  m[6] = lanes[6][l];  m[10] = lanes[10][l];  m[14] = lanes[14][l];
+            m[3] = 0;            m[7] = 0;            m[11] = 0;             m[15] = 1;
+        }
+    }
+    BuildLocalMatricesScalar(idx + k, count - k, out + k); // Tail
+}
+
+// MultiplyMatrix with one 4-wide column per step (SSE / NEON), scalar otherwise
+void MultiplyMatrixSimd(const float a[16], const float b[16], float out[16]) {
+#if defined(__SSE2__)
+    __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+    for (int col = 0; col < 4; col++) {
+        const float* bc = b + col * 4;
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(bc[0])), _mm_mul_ps(a1, _mm_set1_ps(bc[1]))),
+                              _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(bc[2])), _mm_mul_ps(a3, _mm_set1_ps(bc[3]))));
+        _mm_storeu_ps(out + col * 4, r);
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t a0 = vld1q_f32(a), a1 = vld1q_f32(a + 4), a2 = vld1q_f32(a + 8), a3 = vld1q_f32(a + 12);
+    for (int col = 0; col < 4; col++) {
+        const float* bc = b + col * 4;
+        float32x4_t r = vmulq_n_f32(a0, bc[0]);
+        r = vmlaq_n_f32(r, a1, bc[1]);
+        r = vmlaq_n_f32(r, a2, bc[2]);
+        r = vmlaq_n_f32(r, a3, bc[3]);
+        vst1q_f32(out + col * 4, r);
+    }
+#else
+    MultiplyMatrix(a, b, out);
+#endif
+}
+
+// Scalar reference: spin nodes about X by spinSpeed * dt, angles kept in [0, 360)
+// so a clock left running for days doesn't lose float precision
+void AnimateSpinsScalar(uint32_t begin, uint32_t end, float dt) {
+    for (uint32_t i = begin; i < end; i++) {
+        if (!scene.spinning[i]) continue;
+        float r = scene.rotX[i] - scene.spinSpeed[i] * dt;
+        scene.rotX[i] = r - 360.0f * floorf(r * (1.0f / 360.0f));
+    }
+}
+
+// Same as AnimateSpinsScalar, branch-free over SIMD_WIDTH nodes (non-spinning lanes keep their angle)
+void AnimateSpinsSimd(uint32_t begin, uint32_t end, float dt) {
+    float* rot = scene.rotX.data();
+    const float* speed = scene.spinSpeed.data();
+    const uint8_t* spinning = scene.spinning.data();
+
+    uint32_t i = begin;
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+        VFloat r = VLoad(rot + i);
+        VFloat moved = VSub(r, VMul(VLoad(speed + i), VSet(dt)));
+        VFloat wrapped = VSub(moved, VMul(VSet(360.0f), VFloor(VMul(moved, VSet(1.0f / 360.0f)))));
+        VStore(rot + i, VSelect(r, wrapped, VLoadFlags(spinning + i)));
+    }
+    for (; i < end; i++) {
+        if (!spinning[i]) continue;
+        float r = rot[i] - speed[i] * dt;
+        rot[i] = r - 360.0f * floorf(r * (1.0f / 360.0f));
+    }
+}
+
+// Flags node i's subtree for a world-matrix rebuild and marks the path up to the root
+void MarkDirty(uint32_t i) {
+    scene.dirty[i] = 1;
+    for (int32_t p = scene.parent[i]; p >= 0 && !scene.childDirty[p]; p = scene.parent[p]) scene.childDirty[p] = 1;
+}
+
+// Recomputes world matrices only along dirty branches. The walk jumps over clean
+// subtrees via subtreeEnd and gathers the stale nodes; their local matrices are then
+// built in batches, and parents (which come first) are folded in front to back.
+// A dirty subtree only reads worlds inside itself or clean ones above it, so
+// batches split at subtree starts can run on the job system independently.
+// Returns the nodes whose world matrix was recomputed.
+const std::vector<uint32_t>& UpdateSceneTransforms() {
+    static std::vector<uint32_t> rebuild;
+    static std::vector<uint32_t> batchStarts;   // Offsets into rebuild, each at a dirty-subtree start
+    static std::vector<Matrix4> locals;
+    rebuild.clear();
+    batchStarts.clear();
+
+    uint32_t n = scene.Count();
+    for (uint32_t i = 0; i < n;) {
+        if (scene.dirty[i]) {
+            if (batchStarts.empty() || rebuild.size() - batchStarts.back() >= FRAME_JOB_GRAIN) batchStarts.push_back(rebuild.size());
+            uint32_t end = scene.subtreeEnd[i];
+            for (uint32_t j = i; j < end; j++) {
+                rebuild.push_back(j);
+                scene.dirty[j] = 0;
+                scene.childDirty[j] = 0;
+            }
+            i = end;
+        } else if (scene.childDirty[i]) {
+            scene.childDirty[i] = 0;
+            i++;
+        } else {
+            i = scene.subtreeEnd[i];
+        }
+    }
+    if (rebuild.empty()) return rebuild;
+    batchStarts.push_back(rebuild.size());
+
+    locals.resize(rebuild.size());
+    frameJobs.ParallelFor(batchStarts.size() - 1, 1, [&](uint32_t firstBatch, uint32_t lastBatch) {
+        uint32_t begin = batchStarts[firstBatch], end = batchStarts[lastBatch];
+        if (useSimdTransforms) BuildLocalMatricesSimd(&rebuild[begin], end - begin, &locals[begin]);
+        else BuildLocalMatricesScalar(&rebuild[begin], end - begin, &locals[begin]);
+
+        for (uint32_t k = begin; k < end; k++) {
+            uint32_t j = rebuild[k];
+            int32_t p = scene.parent[j];
+            if (p < 0) scene.world[j] = locals[k];
+            else if (useSimdTransforms) MultiplyMatrixSimd(scene.world[p].m, locals[k].m, scene.world[j].m);
+            else MultiplyMatrix(scene.world[p].m, locals[k].m, scene.world[j].m);
+        }
+    });
+    return rebuild;
+}
+
+// Runs both kernels over the whole scene and reports the largest difference
+// (the SIMD sin/cos are polynomial, so expect ~1e-6, not exact equality)
+float CompareTransformKernels() {
+    uint32_t n = scene.Count();
+    std::vector<uint32_t> all(n);
+    for (uint32_t i = 0; i < n; i++) all[i] = i;
+    std::vector<Matrix4> ref(n), simd(n);
+    BuildLocalMatricesScalar(all.data(), n, ref.data());
+    BuildLocalMatricesSimd(all.data(), n, simd.data());
+
+    float maxError = 0.0f;
+    for (uint32_t i = 0; i < n; i++) {
+        for (int k = 0; k < 16; k++) maxError = std::max(maxError, fabsf(ref[i].m[k] - simd[i].m[k]));
+    }
+    return maxError;
+}
+
+// Orbit camera position (display() looks from here at the origin)
+void CameraEye(float eye[3]) {
+    eye[0] = cameraDist * sin(cameraAngle);
+    eye[1] = cameraDist * cos(cameraAngle);
+    eye[2] = cameraHeight;
+}
+
+// Six planes (a, b, c, d) with normals pointing inside, a*x + b*y + c*z + d >= 0
+struct Frustum {
+    float planes[6][4];
+};
+
+// Gribb/Hartmann plane extraction from projection * view
+Frustum ExtractFrustum(const float clip[16]) {
+    Frustum f;
+    for (int i = 0; i < 3; i++) {
+        for (int k = 0; k < 4; k++) {
+            float rowW = clip[k * 4 + 3];
+            float rowI = clip[k * 4 + i];
+            f.planes[2 * i + 0][k] = rowW + rowI; // left / bottom / near
+            f.planes[2 * i + 1][k] = rowW - rowI; // right / top / far
+        }
+    }
+    for (auto& p : f.planes) {
+        float len = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+        if (len > 0.0f) for (int k = 0; k < 4; k++) p[k] /= len;
+    }
+    return f;
+}
+
+// World-space AABB (center + half extents) of the model bounds under a world matrix
+void WorldBoxCenterExtent(const Model* m, const float world[16], float c[3], float e[3]) {
+    for (int r = 0; r < 3; r++) {
+        c[r] = world[12 + r];
+        e[r] = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            float half = 0.5f * (m->boundsMax[k] - m->boundsMin[k]);
+            c[r] += world[k * 4 + r] * m->center[k];
+            e[r] += fabs(world[k * 4 + r]) * half;
+        }
+    }
+}
+
+Aabb WorldBox(const Model* m, const float world[16]) {
+    float c[3], e[3];
+    WorldBoxCenterExtent(m, world, c, e);
+    Aabb box;
+    for (int k = 0; k < 3; k++) { box.lo[k] = c[k] - e[k]; box.hi[k] = c[k] + e[k]; }
+    return box;
+}
+
+// Model bounds under a world matrix: sphere test first, then the world-space AABB
+bool IsVisible(const Frustum& f, const Model* m, const float world[16]) {
+    float c[3], e[3];
+    WorldBoxCenterExtent(m, world, c, e);
+
+    float maxScale = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        maxScale = std::max(maxScale, world[k * 4 + 0] * world[k * 4 + 0] + world[k * 4 + 1] * world[k * 4 + 1] + world[k * 4 + 2] * world[k * 4 + 2]);
+    }
+    float radius = m->radius * sqrt(maxScale);
+
+    for (const auto& p : f.planes) {
+        float dist = p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3];
+        if (dist < -radius) return false;
+        float reach = fabs(p[0]) * e[0] + fabs(p[1]) * e[1] + fabs(p[2]) * e[2];
+        if (dist < -reach) return false;
+    }
+    return true;
+}
+
+// -1 = box outside a plane, 1 = inside all six, 0 = straddling
+int ClassifyBox(const Frustum& f, const Aabb& box) {
+    int result = 1;
+    for (const auto& p : f.planes) {
+        float dist = p[3], reach = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            dist += p[k] * 0.5f * (box.lo[k] + box.hi[k]);
+            reach += fabs(p[k]) * 0.5f * (box.hi[k] - box.lo[k]);
+        }
+        if (dist < -reach) return -1;
+        if (dist < reach) result = 0;
+    }
+    return result;
+}
+
+void BuildSceneBvh() {
+    std::vector<Aabb> boxes;
+    sceneBvhNodes.clear();
+    nodeBvhItem.assign(scene.Count(), -1);
+    for (uint32_t i = 0; i < scene.Count(); i++) {
+        const Model* m = scene.model[i];
+        if (!m || !m->loaded) continue;
+        nodeBvhItem[i] = sceneBvhNodes.size();
+        sceneBvhNodes.push_back(i);
+        boxes.push_back(WorldBox(m, scene.world[i].m));
+    }
+    sceneBvh.Build(boxes, 2);
+    sceneBvhBuildArea = sceneBvh.RootArea();
+    sceneBvhDirty = false;
+}
+
+// Brings the scene BVH up to date after UpdateSceneTransforms(): a rebuild if
+// objects came or went, otherwise a refit of the ones that moved. Refits keep the
+// tree shape, so once they have stretched the root too far the tree is rebuilt.
+void UpdateSceneBvh(const std::vector<uint32_t>& moved) {
+    if (sceneBvhDirty) { BuildSceneBvh(); return; }
+    bool refit = false;
+    for (uint32_t i : moved) {
+        if (nodeBvhItem[i] < 0) continue;
+        sceneBvh.Update(nodeBvhItem[i], WorldBox(scene.model[i], scene.world[i].m));
+        refit = true;
+    }
+    if (!refit) return;
+    sceneBvh.Refit();
+    if (sceneBvh.RootArea() > BVH_REBUILD_GROWTH * sceneBvhBuildArea) BuildSceneBvh();
+}
+
+bool IsBatched(uint32_t i) {
+    return useStaticBatching && i < nodeBatch.size() && nodeBatch[i] >= 0;
+}
+
+// Fills visibleObjects with loaded objects whose bounds touch the current view frustum,
+// and visibleBatches with the static batches that do (their members are left out)
+void CullObjects() {
+    visibleObjects.clear();
+    visibleBatches.clear();
+    culledCount = 0;
+
+    // Matrices as set by reshape() (gluPerspective) and display() (gluLookAt)
+    float proj[16], view[16], clip[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, proj);
+    glGetFloatv(GL_MODELVIEW_MATRIX, view);
+    MultiplyMatrix(proj, view, clip);
+    Frustum frustum = ExtractFrustum(clip);
+
+    static const float IDENTITY[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+    for (uint32_t b = 0; useStaticBatching && b < staticBatches.size(); b++) {
+        const Model& mesh = staticBatches[b]->mesh;
+        if (mesh.lods.empty() || mesh.lods[0].indexCount == 0) continue;
+        if (!useFrustumCulling || IsVisible(frustum, &mesh, IDENTITY)) {
+            visibleBatches.push_back(b);
+            continue;
+        }
+        for (uint32_t i : staticBatches[b]->members) culledCount += nodeBatch[i] == (int32_t)b; // Objects, like the rest of the count
+    }
+
+    // BVH: whole subtrees are rejected / accepted by their box, leaves get the object test.
+    // Sorted back into scene order so the draw list matches the linear scan.
+    if (useFrustumCulling && useBvhCulling) {
+        sceneBvh.Traverse([&](const Aabb& box) { return ClassifyBox(frustum, box); }, [&](uint32_t item, bool inside) {
+            uint32_t i = sceneBvhNodes[item];
+            if (IsBatched(i)) return;
+            if (inside || IsVisible(frustum, scene.model[i], scene.world[i].m)) visibleObjects.push_back(i);
+        });
+        std::sort(visibleObjects.begin(), visibleObjects.end());
+
+        // Culled = the tree's drawable unbatched objects that didn't come out visible
+        int candidates = 0;
+        for (uint32_t i : sceneBvhNodes) {
+            const Model* m = scene.model[i];
+            candidates += m && m->loaded && !IsBatched(i);
+        }
+        culledCount += std::max(0, candidates - (int)visibleObjects.size());
+        return;
+    }
+
+    // Each chunk culls its own node range into its own list; concatenating them keeps scene order
+    static std::vector<std::vector<uint32_t>> chunkVisible;
+    static std::vector<int> chunkCulled;
+    uint32_t chunks = (scene.Count() + FRAME_JOB_GRAIN - 1) / FRAME_JOB_GRAIN;
+    chunkVisible.resize(chunks);
+    chunkCulled.assign(chunks, 0);
+
+    frameJobs.ParallelFor(scene.Count(), FRAME_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        uint32_t c = begin / FRAME_JOB_GRAIN;
+        std::vector<uint32_t>& out = chunkVisible[c];
+        out.clear();
+        for (uint32_t i = begin; i < end; i++) {
+            const Model* m = scene.model[i];
+            if (!m || !m->loaded || IsBatched(i)) continue;
+            if (useFrustumCulling && !IsVisible(frustum, m, scene.world[i].m)) {
+                chunkCulled[c]++;
+                continue;
+            }
+            out.push_back(i);
+        }
+    });
+
+    for (uint32_t c = 0; c < chunks; c++) {
+        visibleObjects.insert(visibleObjects.end(), chunkVisible[c].begin(), chunkVisible[c].end());
+        culledCount += chunkCulled[c];
+    }
+}
+
+// ------------------------------------------
+// Normal and tangent generation (import)
+// ------------------------------------------
+// Runs on importJobs from the loader threads. Per-triangle terms are
+// computed SIMD_WIDTH triangles per step into corner-major arrays; each position
+// (normals) or vertex (tangents) then sums its own corners through a CSR
+// adjacency, so no two chunks write the same slot and the result doesn't depend
+// on the thread count. NORMAL_JOB_GRAIN is a multiple of SIMD_WIDTH, so only the
+// last chunk has a partial step, and that spills into the arrays' padding.
+
+struct VVec3 {
+    VFloat x, y, z;
+};
+
+inline VVec3 VSub3(const VVec3& a, const VVec3& b) { return { VSub(a.x, b.x), VSub(a.y, b.y), VSub(a.z, b.z) }; }
+inline VVec3 VScale3(const VVec3& a, VFloat s) { return { VMul(a.x, s), VMul(a.y, s), VMul(a.z, s) }; }
+inline VFloat VDot3(const VVec3& a, const VVec3& b) { return VAdd(VAdd(VMul(a.x, b.x), VMul(a.y, b.y)), VMul(a.z, b.z)); }
+inline VVec3 VCross3(const VVec3& a, const VVec3& b) {
+    return { VSub(VMul(a.y, b.z), VMul(a.z, b.y)), VSub(VMul(a.z, b.x), VMul(a.x, b.z)), VSub(VMul(a.x, b.y), VMul(a.y, b.x)) };
+}
+
+// acos on [-1, 1] (Abramowitz & Stegun 4.4.45, |error| < 7e-5 rad). Negative lanes
+// take pi - acos(|x|): the factor (|x| - x) / 2|x| is exactly 1 for them, 0 otherwise.
+inline VFloat VAcos(VFloat x) {
+    VFloat a = VMax(x, VSub(VSet(0.0f), x));
+    VFloat p = VAdd(VMul(a, VSet(-0.0187293f)), VSet(0.0742610f));
+    p = VAdd(VMul(p, a), VSet(-0.2121144f));
+    p = VAdd(VMul(p, a), VSet(1.5707288f));
+    VFloat r = VMul(p, VSqrt(VMax(VSub(VSet(1.0f), a), VSet(0.0f))));
+    VFloat negative = VDiv(VSub(a, x), VMax(VAdd(a, a), VSet(1e-30f)));
+    return VAdd(r, VMul(negative, VSub(VSet(3.14159265f), VAdd(r, r))));
+}
+
+const uint32_t VERTEX_FLOATS = sizeof(Vertex) / sizeof(float);
+
+// Float offsets (into the vertex array) of corner c of triangles t .. t + SIMD_WIDTH;
+// lanes past the last triangle repeat it
+void GatherTriangleCorners(const unsigned int* tris, uint32_t t, uint32_t numTris, uint32_t ix[3][SIMD_WIDTH]) {
+    for (int l = 0; l < SIMD_WIDTH; l++) {
+        uint32_t tri = std::min(t + l, numTris - 1);
+        for (int c = 0; c < 3; c++) ix[c][l] = tris[3 * tri + c] * VERTEX_FLOATS;
+    }
+}
+
+VVec3 GatherVec3(const float* base, const uint32_t* ix) {
+    return { VGather(base, ix), VGather(base + 1, ix), VGather(base + 2, ix) };
+}
+
+// m's triangle list; soup meshes (no indices) get 0, 1, 2, ... in scratch
+const unsigned int* TriangleIndices(const Model* m, ArenaVector<unsigned int>& scratch) {
+    if (!m->indices.empty()) return m->indices.data();
+    scratch.resize(m->vertices.size());
+    for (size_t i = 0; i < scratch.size(); i++) scratch[i] = i;
+    return scratch.data();
+}
+
+// CSR: the i with keys[i] == k are items[offsets[k] .. offsets[k + 1]), ascending
+void BuildAdjacency(const ArenaVector<uint32_t>& keys, uint32_t numKeys, ArenaVector<uint32_t>& offsets, ArenaVector<uint32_t>& items) {
+    offsets.assign(numKeys + 1, 0);
+    for (uint32_t k : keys) offsets[k + 1]++;
+    for (uint32_t k = 0; k < numKeys; k++) offsets[k + 1] += offsets[k];
+    ArenaVector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    items.resize(keys.size());
+    for (uint32_t i = 0; i < keys.size(); i++) items[fill[keys[i]]++] = i;
+}
+
+// Smooth normals for every vertex (normalWeighting). Unless uniquePositions, vertices
+// that only differ by UV (seams) are merged by position so they share one normal.
+void GenerateNormals(Model* m, bool uniquePositions) {
+    uint32_t numVerts = m->vertices.size();
+    ArenaVector<unsigned int> scratch;
+    const unsigned int* tris = TriangleIndices(m, scratch);
+    uint32_t numTris = (m->indices.empty() ? numVerts : m->indices.size()) / 3;
+    if (numTris == 0) return;
+
+    ArenaVector<uint32_t> posOf(numVerts);
+    uint32_t numPos = numVerts;
+    if (uniquePositions) {
+        for (uint32_t v = 0; v < numVerts; v++) posOf[v] = v;
+    } else {
+        ArenaHashMap<Vertex, uint32_t, PositionHash, PositionEqual> unique;
+        unique.reserve(numVerts);
+        for (uint32_t v = 0; v < numVerts; v++) posOf[v] = unique.emplace(m->vertices[v], (uint32_t)unique.size()).first->second;
+        numPos = unique.size();
+    }
+
+    // Weighted face normal per corner; corner c of triangle t lives at c * stride + t
+    uint32_t stride = (numTris + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+    ArenaVector<float> cx(3 * stride), cy(3 * stride), cz(3 * stride);
+    bool angleWeighted = normalWeighting == NORMALS_ANGLE;
+    const float* base = &m->vertices[0].px;
+    importJobs.ParallelFor(numTris, NORMAL_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t t = begin; t < end; t += SIMD_WIDTH) {
+            uint32_t ix[3][SIMD_WIDTH];
+            GatherTriangleCorners(tris, t, numTris, ix);
+            VVec3 p[3] = { GatherVec3(base, ix[0]), GatherVec3(base, ix[1]), GatherVec3(base, ix[2]) };
+            VVec3 face = VCross3(VSub3(p[1], p[0]), VSub3(p[2], p[0])); // Length = 2 * area
+
+            VFloat invLength = VDiv(VSet(1.0f), VMax(VSqrt(VDot3(face, face)), VSet(1e-30f)));
+            for (int c = 0; c < 3; c++) {
+                VVec3 w = face;
+                if (angleWeighted) {
+                    VVec3 a = VSub3(p[(c + 1) % 3], p[c]), b = VSub3(p[(c + 2) % 3], p[c]);
+                    VFloat lengths = VMax(VSqrt(VMul(VDot3(a, a), VDot3(b, b))), VSet(1e-30f));
+                    VFloat cosine = VMax(VMin(VDiv(VDot3(a, b), lengths), VSet(1.0f)), VSet(-1.0f));
+                    w = VScale3(face, VMul(VAcos(cosine), invLength)); // Unit normal * corner angle
+                }
+                VStore(&cx[c * stride + t], w.x);
+                VStore(&cy[c * stride + t], w.y);
+                VStore(&cz[c * stride + t], w.z);
+            }
+        }
+    });
+
+    ArenaVector<uint32_t> keys(3 * numTris), offsets, corners;
+    for (uint32_t i = 0; i < 3 * numTris; i++) keys[i] = posOf[tris[i]];
+    BuildAdjacency(keys, numPos, offsets, corners);
+
+    // Each position sums its corners and normalises (SIMD over the chunk)
+    ArenaVector<float> nx(numPos + SIMD_WIDTH), ny(numPos + SIMD_WIDTH), nz(numPos + SIMD_WIDTH);
+    importJobs.ParallelFor(numPos, NORMAL_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t p = begin; p < end; p++) {
+            float x = 0.0f, y = 0.0f, z = 0.0f;
+            for (uint32_t k = offsets[p]; k < offsets[p + 1]; k++) {
+                uint32_t i = corners[k];
+                uint32_t slot = (i % 3) * stride + i / 3;
+                x += cx[slot]; y += cy[slot]; z += cz[slot];
+            }
+            nx[p] = x; ny[p] = y; nz[p] = z;
+        }
+        for (uint32_t p = begin; p < end; p += SIMD_WIDTH) {
+            VVec3 n = { VLoad(&nx[p]), VLoad(&ny[p]), VLoad(&nz[p]) };
+            n = VScale3(n, VDiv(VSet(1.0f), VMax(VSqrt(VDot3(n, n)), VSet(1e-30f))));
+            VStore(&nx[p], n.x); VStore(&ny[p], n.y); VStore(&nz[p], n.z);
+        }
+    });
+
+    importJobs.ParallelFor(numVerts, NORMAL_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t v = begin; v < end; v++) {
+            Vertex& vert = m->vertices[v];
+            uint32_t p = posOf[v];
+            vert.nx = nx[p]; vert.ny = ny[p]; vert.nz = nz[p];
+            if (vert.nx == 0.0f && vert.ny == 0.0f && vert.nz == 0.0f) vert.nz = 1.0f; // Only degenerate faces
+        }
+    });
+    m->hasNormals = true;
+    m->normalsGenerated = true;
+}
+
+// Per-vertex tangents (Lengyel): the UV-space u direction of the adjacent faces,
+// made orthogonal to the normal, w = handedness of the (normal, tangent, v) frame.
+// A face votes with the sign of its UV determinant rather than 1 / det, so slivers
+// with a tiny UV area don't dominate; faces with degenerate UVs don't vote.
+void GenerateTangents(Model* m) {
+    uint32_t numVerts = m->vertices.size();
+    ArenaVector<unsigned int> scratch;
+    const unsigned int* tris = TriangleIndices(m, scratch);
+    uint32_t numTris = (m->indices.empty() ? numVerts : m->indices.size()) / 3;
+    m->tangents.assign(numVerts, Tangent{ 1.0f, 0.0f, 0.0f, 1.0f });
+    if (numTris == 0) return;
+
+    uint32_t stride = (numTris + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+    ArenaVector<float> sx(stride), sy(stride), sz(stride), bx(stride), by(stride), bz(stride);
+    const float* base = &m->vertices[0].px;
+    const float* uvs = &m->vertices[0].u;
+    importJobs.ParallelFor(numTris, NORMAL_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t t = begin; t < end; t += SIMD_WIDTH) {
+            uint32_t ix[3][SIMD_WIDTH];
+            GatherTriangleCorners(tris, t, numTris, ix);
+            VVec3 p0 = GatherVec3(base, ix[0]);
+            VVec3 e1 = VSub3(GatherVec3(base, ix[1]), p0), e2 = VSub3(GatherVec3(base, ix[2]), p0);
+            VFloat u0 = VGather(uvs, ix[0]), v0 = VGather(uvs + 1, ix[0]);
+            VFloat du1 = VSub(VGather(uvs, ix[1]), u0), dv1 = VSub(VGather(uvs + 1, ix[1]), v0);
+            VFloat du2 = VSub(VGather(uvs, ix[2]), u0), dv2 = VSub(VGather(uvs + 1, ix[2]), v0);
+
+            VFloat det = VSub(VMul(du1, dv2), VMul(du2, dv1));
+            VFloat sign = VDiv(det, VMax(VMax(det, VSub(VSet(0.0f), det)), VSet(1e-30f)));
+            VVec3 s = VScale3(VSub3(VScale3(e1, dv2), VScale3(e2, dv1)), sign);
+            VVec3 b = VScale3(VSub3(VScale3(e2, du1), VScale3(e1, du2)), sign);
+            VStore(&sx[t], s.x); VStore(&sy[t], s.y); VStore(&sz[t], s.z);
+            VStore(&bx[t], b.x); VStore(&by[t], b.y); VStore(&bz[t], b.z);
+        }
+    });
+
+    ArenaVector<uint32_t> keys(tris, tris + 3 * numTris), offsets, corners;
+    BuildAdjacency(keys, numVerts, offsets, corners);
+
+    importJobs.ParallelFor(numVerts, NORMAL_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t v = begin; v < end; v++) {
+            float s[3] = {0, 0, 0}, b[3] = {0, 0, 0};
+            for (uint32_t k = offsets[v]; k < offsets[v + 1]; k++) {
+                uint32_t t = corners[k] / 3;
+                s[0] += sx[t]; s[1] += sy[t]; s[2] += sz[t];
+                b[0] += bx[t]; b[1] += by[t]; b[2] += bz[t];
+            }
+
+            // Gram-Schmidt against the normal; no usable u direction -> any perpendicular
+            const Vertex& vert = m->vertices[v];
+            float n[3] = { vert.nx, vert.ny, vert.nz };
+            float d = n[0] * s[0] + n[1] * s[1] + n[2] * s[2];
+            float tan[3] = { s[0] - n[0] * d, s[1] - n[1] * d, s[2] - n[2] * d };
+            float len = sqrt(tan[0] * tan[0] + tan[1] * tan[1] + tan[2] * tan[2]);
+            if (len < 1e-12f) {
+                float axis[3] = { 0, 0, 0 };
+                axis[fabsf(n[0]) < 0.9f ? 0 : 1] = 1.0f;
+                float ad = n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2];
+                for (int k = 0; k < 3; k++) tan[k] = axis[k] - n[k] * ad;
+                len = sqrt(tan[0] * tan[0] + tan[1] * tan[1] + tan[2] * tan[2]);
+            }
+            float bitangent[3] = { n[1] * tan[2] - n[2] * tan[1], n[2] * tan[0] - n[0] * tan[2], n[0] * tan[1] - n[1] * tan[0] };
+            float handedness = bitangent[0] * b[0] + bitangent[1] * b[1] + bitangent[2] * b[2] < 0.0f ? -1.0f : 1.0f;
+            m->tangents[v] = { tan[0] / len, tan[1] / len, tan[2] / len, handedness };
+        }
+    });
+}
+
+// ------------------------------------------
+// Occlusion culling (queries against last frame's depth)
+// ------------------------------------------
+// Node indices change when a scene loads, so the per-node state goes with it
+void ResetOcclusion() {
+    for (OcclusionState& s : occlusion) {
+        if (s.query) glDeleteQueries(1, &s.query);
+    }
+    occlusion.clear();
+    occlusionTests.clear();
+    occlusionHidden.clear();
+}
+
+// World box of node i grown by the margins the query needs
+void OcclusionBox(uint32_t i, float c[3], float e[3]) {
+    WorldBoxCenterExtent(scene.model[i], scene.world[i].m, c, e);
+    for (int k = 0; k < 3; k++) e[k] = e[k] * (1.0f + OCCLUSION_BOX_MARGIN) + 0.01f;
+}
+
+// Splits the frustum-visible objects by their last query, polling the ones in
+// flight without waiting. Those that were visible (or just entered the frustum)
+// stay in visibleObjects and are drawn as usual; every OCCLUSION_VISIBLE_INTERVAL
+// frames, staggered, one is re-tested. Those that were hidden move to
+// occlusionHidden, are skipped and re-tested against this frame's depth by
+// QueryOccluded(). A hidden one whose last query hasn't come back is drawn, so a
+// GPU running behind costs culling, never a missing object.
+void CullOccluded() {
+    occlusionTests.clear();
+    occlusionHidden.clear();
+    occlusionFrame++;
+    if (!useOcclusionCulling || !occlusionSupported) return;
+    if (occlusion.size() < scene.Count()) occlusion.resize(scene.Count());
+
+    float eye[3];
+    CameraEye(eye);
+    size_t kept = 0;
+    for (uint32_t i : visibleObjects) {
+        OcclusionState& s = occlusion[i];
+        if (s.lastSeen + 1 != occlusionFrame) {
+            s.pending = false;      // Any result in flight is from another view
+            s.occluded = false;
+        } else if (s.pending) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(s.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint samples = 0;
+                glGetQueryObjectuiv(s.query, GL_QUERY_RESULT, &samples);
+                s.occluded = samples == 0;
+                s.pending = false;
+            }
+        }
+        s.lastSeen = occlusionFrame;
+
+        float c[3], e[3];
+        OcclusionBox(i, c, e);
+        bool eyeInside = true;
+        for (int k = 0; k < 3; k++) eyeInside &= fabs(eye[k] - c[k]) < e[k] + OCCLUSION_NEAR_MARGIN;
+        if (eyeInside) s.occluded = false;
+
+        if (s.occluded && !s.pending) {
+            occlusionHidden.push_back(i);
+            renderStats.occluded++;
+            continue;
+        }
+        if (!s.pending && !eyeInside && (i + occlusionFrame) % OCCLUSION_VISIBLE_INTERVAL == 0) occlusionTests.push_back(i);
+        visibleObjects[kept++] = i;
+    }
+    visibleObjects.resize(kept);
+}
+
+// Draws the boxes of nodes into the depth buffer, each inside its own query.
+// No color or depth writes, so the boxes only test.
+void QueryBoxes(const std::vector<uint32_t>& nodes) {
+    for (uint32_t i : nodes) {
+        OcclusionState& s = occlusion[i];
+        if (!s.query) glGenQueries(1, &s.query);
+        float c[3], e[3];
+        OcclusionBox(i, c, e);
+        glPushMatrix();
+        glTranslatef(c[0], c[1], c[2]);
+        glScalef(e[0], e[1], e[2]);
+        glBeginQuery(occlusionTarget, s.query);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glEndQuery(occlusionTarget);
+        glPopMatrix();
+        s.pending = true;
+        renderStats.occlusionQueries++;
+    }
+}
+
+// After the scene draw: queries the boxes of the hidden objects and the visible
+// ones due a re-test against its depth. CullOccluded() reads them in a later frame
+// once they are available.
+void QueryOccluded() {
+    if (occlusionHidden.empty() && occlusionTests.empty()) return;
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDepthFunc(GL_LEQUAL);
+    glBindVertexArray(occlusionBoxVao);
+    QueryBoxes(occlusionHidden);
+    QueryBoxes(occlusionTests);
+    glBindVertexArray(0);
+    glPopAttrib();
+}
+
+// ------------------------------------------
+// Picking (rays against the scene BVH)
+// ------------------------------------------
+// Inverse of an affine column-major matrix (rotation/scale/shear + translation)
+bool InvertAffine(const float m[16], float out[16]) {
+    float a = m[0], b = m[4], c = m[8];
+    float d = m[1], e = m[5], f = m[9];
+    float g = m[2], h = m[6], k = m[10];
+    float A = e * k - f * h, B = f * g - d * k, C = d * h - e * g;
+    float det = a * A + b * B + c * C;
+    if (fabs(det) < 1e-20f) return false;
+    float s = 1.0f / det;
+    out[0] = A * s;               out[4] = (c * h - b * k) * s; out[8]  = (b * f - c * e) * s;
+    out[1] = B * s;               out[5] = (a * k - c * g) * s; out[9]  = (c * d - a * f) * s;
+    out[2] = C * s;               out[6] = (b * g - a * h) * s; out[10] = (a * e - b * d) * s;
+    out[3] = 0.0f; out[7] = 0.0f; out[11] = 0.0f; out[15] = 1.0f;
+    for (int r = 0; r < 3; r++) out[12 + r] = -(out[r] * m[12] + out[4 + r] * m[13] + out[8 + r] * m[14]);
+    return true;
+}
+
+// Corner positions of triangle t (LOD 0)
+void TriangleCorners(const Model* m, uint32_t t, const float* p[3]) {
+    for (int k = 0; k < 3; k++) {
+        uint32_t v = m->indices.empty() ? 3 * t + k : m->indices[3 * t + k];
+        p[k] = &m->vertices[v].px;
+    }
+}
+
+uint32_t TriangleCount(const Model* m) {
+    return m->indices.empty() ? m->vertices.size() / 3 : m->lods[0].indexCount / 3;
+}
+
+void BuildTriangleBvh(Model* m) {
+    std::vector<Aabb> boxes(TriangleCount(m));
+    for (uint32_t t = 0; t < boxes.size(); t++) {
+        const float* p[3];
+        TriangleCorners(m, t, p);
+        for (int k = 0; k < 3; k++) boxes[t].Grow(p[k]);
+    }
+    m->triangleBvh.Build(boxes, 4);
+}
+
+// Moller-Trumbore, both sides; lowers tMax on a nearer hit
+bool RayTriangle(const float o[3], const float d[3], const float* p[3], float& tMax) {
+    float e1[3], e2[3], s[3];
+    for (int k = 0; k < 3; k++) { e1[k] = p[1][k] - p[0][k]; e2[k] = p[2][k] - p[0][k]; s[k] = o[k] - p[0][k]; }
+    float q[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+    float det = e1[0] * q[0] + e1[1] * q[1] + e1[2] * q[2];
+    if (fabs(det) < 1e-12f) return false;
+    float inv = 1.0f / det;
+    float u = (s[0] * q[0] + s[1] * q[1] + s[2] * q[2]) * inv;
+    if (u < 0.0f || u > 1.0f) return false;
+    float r[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+    float v = (d[0] * r[0] + d[1] * r[1] + d[2] * r[2]) * inv;
+    if (v < 0.0f || u + v > 1.0f) return false;
+    float t = (e2[0] * r[0] + e2[1] * r[1] + e2[2] * r[2]) * inv;
+    if (t < 0.0f || t >= tMax) return false;
+    tMax = t;
+    return true;
+}
+
+// Ray in model space against the mesh's triangles. The ray direction isn't
+// normalized, so t means the same thing here as in world space.
+bool RaycastModel(Model* m, const float origin[3], const float dir[3], float& tMax) {
+    if (m->triangleBvh.Empty()) BuildTriangleBvh(m);
+    bool hit = false;
+    m->triangleBvh.Raycast(origin, dir, tMax, [&](uint32_t t, float& tBest) {
+        const float* p[3];
+        TriangleCorners(m, t, p);
+        hit |= RayTriangle(origin, dir, p, tBest);
+    });
+    return hit;
+}
+
+// Nearest object along origin + t * dir (t in [0, tMax]); -1 if nothing is hit
+int32_t PickObject(const float origin[3], const float dir[3], float& tMax) {
+    int32_t best = -1;
+    sceneBvh.Raycast(origin, dir, tMax, [&](uint32_t item, float& tBest) {
+        uint32_t i = sceneBvhNodes[item];
+        float inv[3], entry;
+        for (int k = 0; k < 3; k++) inv[k] = dir[k] != 0.0f ? 1.0f / dir[k] : 1e30f;
+        if (!Bvh::RayBox(sceneBvh.ItemBounds(item), origin, inv, tBest, entry)) return;
+
+        if (!usePickTriangles) {
+            tBest = entry;
+            best = i;
+            return;
+        }
+        float toLocal[16];
+        if (!InvertAffine(scene.world[i].m, toLocal)) return;
+        float o[3], d[3];
+        for (int r = 0; r < 3; r++) {
+            o[r] = toLocal[12 + r] + toLocal[r] * origin[0] + toLocal[4 + r] * origin[1] + toLocal[8 + r] * origin[2];
+            d[r] = toLocal[r] * dir[0] + toLocal[4 + r] * dir[1] + toLocal[8 + r] * dir[2];
+        }
+        if (RaycastModel(scene.model[i], o, d, tBest)) best = i;
+    });
+    return best;
+}
+
+// World-space ray through a window pixel: origin on the near plane, origin + dir on the far plane
+void ScreenRay(int x, int y, float origin[3], float dir[3]) {
+    GLdouble view[16], proj[16];
+    GLint viewport[4];
+    glGetDoublev(GL_PROJECTION_MATRIX, proj);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    float eye[3];
+    CameraEye(eye);
+    glPushMatrix();
+    glLoadIdentity();
+    gluLookAt(eye[0], eye[1], eye[2],  0, 0, 0,  0, 0, 1);
+    glGetDoublev(GL_MODELVIEW_MATRIX, view);
+    glPopMatrix();
+
+    double wx = x + 0.5, wy = viewport[3] - y - 0.5; // GLUT counts rows from the top
+    double nearP[3], farP[3];
+    gluUnProject(wx, wy, 0.0, view, proj, viewport, &nearP[0], &nearP[1], &nearP[2]);
+    gluUnProject(wx, wy, 1.0, view, proj, viewport, &farP[0], &farP[1], &farP[2]);
+    for (int k = 0; k < 3; k++) {
+        origin[k] = nearP[k];
+        dir[k] = farP[k] - nearP[k];
+    }
+}
+
+// Selection Highlight
+bool IsHighlightPulsing() {
+    return scene.IndexOf(selectedObject) >= 0 && NowSeconds() - selectionTime < HIGHLIGHT_PULSE_SECONDS;
+}
+
+// Selecting a group highlights everything under it (its subtree range)
+bool IsSelected(uint32_t i) {
+    int32_t sel = scene.IndexOf(selectedObject);
+    return sel >= 0 && i >= (uint32_t)sel && i < scene.subtreeEnd[sel];
+}
+
+// Brightness of the selection highlight this frame (GLUT thread: reads the GLUT clock)
+float HighlightPulse() {
+    if (!IsHighlightPulsing()) return 1.0f;
+    return (sin(glutGet(GLUT_ELAPSED_TIME) * 0.005f) + 1.0f) * 0.2f + 0.8f;
+}
+
+void ObjectColor(uint32_t i, float pulse, float color[4]) {
+    if (IsSelected(i)) {
+        color[0] = pulse; color[1] = pulse; color[2] = 0.5f;
+    } else {
+        color[0] = color[1] = color[2] = 1.0f;
+    }
+    color[3] = 1.0f;
+}
+
+// ------------------------------------------
+// Static batching
+// ------------------------------------------
+// A mesh that is drawn in place and never moves by itself: small enough, loaded,
+// and neither it nor any parent spins
+bool IsStaticMesh(uint32_t i) {
+    const Model* m = scene.model[i];
+    if (!m || !m->loaded || m->vertices.empty() || m->vertices.size() > STATIC_OBJECT_MAX_VERTICES) return false;
+    for (int32_t p = i; p >= 0; p = scene.parent[p]) {
+        if (scene.spinning[p]) return false;
+    }
+    return true;
+}
+
+// Not selected (it needs its own color) and not edited in the last STATIC_SETTLE_SECONDS
+bool IsSettled(uint32_t i, double now) {
+    if (IsSelected(i)) return false;
+    return i >= nodeEditTime.size() || now - nodeEditTime[i] >= STATIC_SETTLE_SECONDS;
+}
+
+void FreeStaticBatches() {
+    for (StaticBatch* b : staticBatches) {
+        FreeModelBuffers(b->mesh);
+        delete b;
+    }
+    staticBatches.clear();
+    nodeBatch.clear();
+    nodeEditTime.clear();
+    pulledNodes.clear();
+    visibleBatches.clear();
+    batchedNodeCount = 0;
+    staticBatchesDirty = true;
+}
+
+// Node i's LOD 0 in world space, appended to the batch (normals by the inverse transpose)
+void AppendToBatch(StaticBatch& b, uint32_t i) {
+    const Model* m = scene.model[i];
+    const float* w = scene.world[i].m;
+    float inv[16];
+    bool invertible = InvertAffine(w, inv);
+
+    uint32_t base = b.mesh.vertices.size();
+    for (const Vertex& v : m->vertices) {
+        Vertex out = v;
+        out.px = w[0] * v.px + w[4] * v.py + w[8] * v.pz + w[12];
+        out.py = w[1] * v.px + w[5] * v.py + w[9] * v.pz + w[13];
+        out.pz = w[2] * v.px + w[6] * v.py + w[10] * v.pz + w[14];
+        if (m->hasNormals && invertible) {
+            float n[3];
+            for (int r = 0; r < 3; r++) n[r] = inv[r * 4 + 0] * v.nx + inv[r * 4 + 1] * v.ny + inv[r * 4 + 2] * v.nz;
+            float len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (len > 0.0f) { out.nx = n[0] / len; out.ny = n[1] / len; out.nz = n[2] / len; }
+        }
+        b.mesh.vertices.push_back(out);
+    }
+
+    if (m->indices.empty()) {
+        for (uint32_t k = 0; k < m->vertices.size(); k++) b.indices.push_back(base + k);
+    } else {
+        const MeshLod& lod = m->lods[0];
+        for (uint32_t k = 0; k < lod.indexCount; k++) b.indices.push_back(base + m->indices[lod.indexOffset + k]);
+    }
+}
+
+// Rewrites the index buffer with the members still drawn by the batch. Pulled-out
+// members keep their vertices until the next rebuild; they just aren't referenced.
+void UploadBatchIndices(uint32_t bi) {
+    StaticBatch& b = *staticBatches[bi];
+    std::vector<unsigned int> drawn;
+    for (size_t k = 0; k < b.members.size(); k++) {
+        if (nodeBatch[b.members[k]] != (int32_t)bi) continue;
+        drawn.insert(drawn.end(), b.indices.begin() + b.memberIndices[k], b.indices.begin() + b.memberIndices[k + 1]);
+    }
+    b.mesh.lods[0].indexCount = drawn.size();
+    if (drawn.empty()) return;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, b.mesh.ibo);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, drawn.size() * sizeof(unsigned int), drawn.data());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Merges the batch's current members (b.members with nodeBatch pointing here) from
+// their source meshes into fresh buffers
+void RebuildBatch(uint32_t bi) {
+    StaticBatch& b = *staticBatches[bi];
+    std::vector<uint32_t> members;
+    for (uint32_t i : b.members) {
+        if (nodeBatch[i] == (int32_t)bi) members.push_back(i);
+    }
+
+    FreeModelBuffers(b.mesh);
+    b.mesh.vertexCount = 0;
+    b.members = members;
+    b.memberIndices.clear();
+    b.indices.clear();
+    for (uint32_t i : members) {
+        b.memberIndices.push_back(b.indices.size());
+        AppendToBatch(b, i);
+    }
+    b.memberIndices.push_back(b.indices.size());
+
+    b.mesh.indices = b.indices;
+    b.mesh.lods = { { 0, (uint32_t)b.indices.size(), 0.0f } };
+    ComputeBounds(&b.mesh);
+    if (!b.mesh.vertices.empty()) UploadModel(&b.mesh);
+    b.mesh.vertices.clear(); // Only the GPU copy is drawn; rebuilds start from the sources
+    b.mesh.vertices.shrink_to_fit();
+    b.mesh.indices.clear();
+    b.mesh.indices.shrink_to_fit();
+    b.mesh.loaded = true;
+    b.needsRebuild = false;
+}
+
+// First batch drawing node i's texture and vertex format with room for its vertices
+int32_t FindBatchFor(uint32_t i) {
+    const Model* m = scene.model[i];
+    for (uint32_t bi = 0; bi < staticBatches.size(); bi++) {
+        const Model& mesh = staticBatches[bi]->mesh;
+        if (mesh.texture != m->texture || mesh.hasNormals != m->hasNormals || mesh.hasTexcoords != m->hasTexcoords) continue;
+        if (mesh.vertexCount + m->vertices.size() <= STATIC_BATCH_MAX_VERTICES) return bi;
+    }
+    StaticBatch* b = new StaticBatch();
+    b->mesh.name = "static batch " + std::to_string(staticBatches.size());
+    b->mesh.texture = m->texture; // Not an extra reference: batches go before the models do
+    b->mesh.hasNormals = m->hasNormals;
+    b->mesh.hasTexcoords = m->hasTexcoords;
+    staticBatches.push_back(b);
+    return staticBatches.size() - 1;
+}
+
+// Puts i into its batch; the batch is rebuilt by UpdateStaticBatches()
+void JoinStaticBatch(uint32_t i) {
+    int32_t bi = FindBatchFor(i);
+    StaticBatch& b = *staticBatches[bi];
+    nodeBatch[i] = bi;
+    if (std::find(b.members.begin(), b.members.end(), i) == b.members.end()) b.members.push_back(i); // May be back from a pull-out
+    b.mesh.vertexCount += scene.model[i]->vertices.size(); // Reserves the room until the rebuild
+    b.needsRebuild = true;
+    batchedNodeCount++;
+}
+
+// From scratch, once every asset is in: each static mesh goes into the first batch
+// of its texture with room, in scene order
+void BuildStaticBatches() {
+    ProfileScope scope("Build batches");
+    FreeStaticBatches();
+    staticBatchesDirty = false;
+    nodeBatch.assign(scene.Count(), -1);
+    nodeEditTime.assign(scene.Count(), 0.0);
+
+    double now = NowSeconds();
+    for (uint32_t i = 0; i < scene.Count(); i++) {
+        if (!IsStaticMesh(i)) continue;
+        if (IsSettled(i, now)) JoinStaticBatch(i);
+        else pulledNodes.push_back(i);
+    }
+    for (uint32_t bi = 0; bi < staticBatches.size(); bi++) RebuildBatch(bi);
+}
+
+// Takes root's subtree out of the batches (edited = the keyboard moved it; it then
+// waits STATIC_SETTLE_SECONDS before it may rejoin). Only index buffers are rewritten.
+void PullFromStaticBatch(uint32_t root, bool edited) {
+    double now = NowSeconds();
+    std::vector<uint32_t> touched;
+    for (uint32_t i = root; i < scene.subtreeEnd[root] && i < nodeBatch.size(); i++) {
+        if (edited) nodeEditTime[i] = now;
+        int32_t bi = nodeBatch[i];
+        if (bi < 0) continue;
+        nodeBatch[i] = -1;
+        batchedNodeCount--;
+        pulledNodes.push_back(i);
+        if (std::find(touched.begin(), touched.end(), (uint32_t)bi) == touched.end()) touched.push_back(bi);
+    }
+    for (uint32_t bi : touched) {
+        if (!staticBatches[bi]->needsRebuild) UploadBatchIndices(bi);
+    }
+}
+
+// m's geometry was replaced (hot reload): the nodes drawing it leave their batches,
+// which rebuild without them, and rejoin wherever the new mesh fits (if it still
+// qualifies) on the next UpdateStaticBatches(). Other batches are left alone.
+void RebatchModel(const Model* m) {
+    if (staticBatchesDirty || nodeBatch.size() != scene.Count()) return; // Full build pending anyway
+    for (uint32_t i = 0; i < scene.Count(); i++) {
+        if (scene.model[i] != m) continue;
+        int32_t bi = nodeBatch[i];
+        if (bi >= 0) {
+            nodeBatch[i] = -1;
+            batchedNodeCount--;
+            staticBatches[bi]->needsRebuild = true;
+        }
+        pulledNodes.push_back(i);
+    }
+}
+
+// Once per frame before culling: the first build after loading, the selection
+// pulled out, and settled nodes back in (rebuilding only the batches they join)
+void UpdateStaticBatches() {
+    if (!useStaticBatching) return;
+    if (staticBatchesDirty || nodeBatch.size() != scene.Count()) {
+        if (pendingAssets == 0) BuildStaticBatches();
+        return;
+    }
+
+    int32_t sel = scene.IndexOf(selectedObject);
+    if (sel >= 0) PullFromStaticBatch(sel, false);
+
+    double now = NowSeconds();
+    size_t waiting = 0;
+    for (uint32_t i : pulledNodes) {
+        if (nodeBatch[i] >= 0 || !IsStaticMesh(i)) continue;
+        if (IsSettled(i, now)) JoinStaticBatch(i);
+        else pulledNodes[waiting++] = i;
+    }
+    pulledNodes.resize(waiting);
+
+    for (uint32_t bi = 0; bi < staticBatches.size(); bi++) {
+        if (staticBatches[bi]->needsRebuild) RebuildBatch(bi);
+    }
+}
+
+// Mirrors the fixed-function setup from init(): GL_COLOR_MATERIAL (ambient + diffuse
+// from the color), two-sided per-vertex lighting, GL_MODULATE texturing. GL_LIGHT0
+// comes from the fixed-function state; scene lights come from world-space uniform
+// arrays (brought into eye space here), so camera moves don't need a re-upload.
+const char* INSTANCED_VS = R"(
+#version 120
+attribute mat4 instanceModel;
+attribute vec4 instanceColor;
+uniform int numLights;
+uniform int numSceneLights;
+uniform vec4 sceneLightPosition[32];    // MAX_SHADER_LIGHTS
+uniform vec4 sceneLightColor[32];
+uniform vec3 sceneLightAttenuation[32];
+varying vec4 frontColor;
+varying vec4 backColor;
+varying vec2 uv;
+
+vec4 Shade(vec3 pos, vec3 n) {
+    vec4 c = gl_LightModel.ambient * instanceColor;
+    for (int i = 0; i < numLights; i++) {
+        vec4 lp = gl_LightSource[i].position;
+        vec3 L = lp.xyz - pos * lp.w;
+        float d = length(L);
+        float atten = lp.w == 0.0 ? 1.0 : 1.0 / (gl_LightSource[i].constantAttenuation
+                                              + gl_LightSource[i].linearAttenuation * d
+                                              + gl_LightSource[i].quadraticAttenuation * d * d);
+        float ndotl = max(dot(n, L / max(d, 1e-6)), 0.0);
+        c += atten * (gl_LightSource[i].ambient + ndotl * gl_LightSource[i].diffuse) * instanceColor;
+    }
+    for (int i = 0; i < numSceneLights; i++) {
+        vec3 L = (gl_ModelViewMatrix * sceneLightPosition[i]).xyz - pos;
+        float d = length(L);
+        vec3 k = sceneLightAttenuation[i];
+        float ndotl = max(dot(n, L / max(d, 1e-6)), 0.0);
+        c += ndotl / (k.x + k.y * d + k.z * d * d) * sceneLightColor[i] * instanceColor;
+    }
+    return clamp(vec4(c.rgb, instanceColor.a), 0.0, 1.0); // Fixed-function clamps before texturing too
+}
+
+void main() {
+    mat4 mv = gl_ModelViewMatrix * instanceModel;
+    vec4 eyePos = mv * gl_Vertex;
+
+    // Inverse-transpose via cofactors (no inverse() in GLSL 1.20)
+    vec3 a = mv[0].xyz, b = mv[1].xyz, c = mv[2].xyz;
+    vec3 bc = cross(b, c);
+    vec3 n = mat3(bc, cross(c, a), cross(a, b)) * gl_Normal;
+    n = (dot(a, bc) < 0.0 ? -1.0 : 1.0) * normalize(n);
+
+    frontColor = Shade(eyePos.xyz, n);
+    backColor = Shade(eyePos.xyz, -n);
+    uv = gl_MultiTexCoord0.xy;
+    gl_Position = gl_ProjectionMatrix * eyePos;
+}
+)";
+
+const char* INSTANCED_FS = R"(
+#version 120
+uniform sampler2D diffuseMap;
+uniform bool useTexture;
+varying vec4 frontColor;
+varying vec4 backColor;
+varying vec2 uv;
+
+void main() {
+    vec4 c = gl_FrontFacing ? frontColor : backColor;
+    if (useTexture) c *= texture2D(diffuseMap, uv);
+    gl_FragColor = c;
+}
+)";
+
+// Same material model as the instanced shader, evaluated per fragment. GL_LIGHT0
+// still comes from the fixed-function state; scene lights come from the cluster
+// textures filled by BuildLightClusters() (eye space, so rebuilt when the view moves).
+const char* CLUSTERED_VS = R"(
+#version 130
+in mat4 instanceModel;
+in vec4 instanceColor;
+out vec3 eyePos;
+out vec3 eyeNormal;
+out vec4 color;
+out vec2 uv;
+
+void main() {
+    mat4 mv = gl_ModelViewMatrix * instanceModel;
+    vec4 p = mv * gl_Vertex;
+
+    // Inverse-transpose via cofactors, as in INSTANCED_VS
+    vec3 a = mv[0].xyz, b = mv[1].xyz, c = mv[2].xyz;
+    vec3 bc = cross(b, c);
+    eyeNormal = (dot(a, bc) < 0.0 ? -1.0 : 1.0) * (mat3(bc, cross(c, a), cross(a, b)) * gl_Normal);
+
+    eyePos = p.xyz;
+    color = instanceColor;
+    uv = gl_MultiTexCoord0.xy;
+    gl_Position = gl_ProjectionMatrix * p;
+}
+)";
+
+const char* CLUSTERED_FS = R"(
+#version 130
+uniform sampler2D diffuseMap;
+uniform bool useTexture;
+uniform int numLights;
+uniform usampler2D clusterGrid;     // (first index, count) per cluster; x = tileX + tileY * 16, y = slice
+uniform usampler2D lightIndices;    // Flat index list, 1024 per row
+uniform sampler2D lightData;        // Per light: (eye pos, range), (color, cutoff), (attenuation, 0)
+uniform vec2 tileSize;              // Pixels per tile
+uniform vec2 sliceScaleBias;        // slice = log(depth) * x + y
+in vec3 eyePos;
+in vec3 eyeNormal;
+in vec4 color;
+in vec2 uv;
+
+void main() {
+    vec3 n = normalize(eyeNormal) * (gl_FrontFacing ? 1.0 : -1.0);
+    vec3 c = gl_LightModel.ambient.rgb * color.rgb;
+
+    for (int i = 0; i < numLights; i++) {
+        vec4 lp = gl_LightSource[i].position;
+        vec3 L = lp.xyz - eyePos * lp.w;
+        float d = length(L);
+        float atten = lp.w == 0.0 ? 1.0 : 1.0 / (gl_LightSource[i].constantAttenuation
+                                              + gl_LightSource[i].linearAttenuation * d
+                                              + gl_LightSource[i].quadraticAttenuation * d * d);
+        float ndotl = max(dot(n, L / max(d, 1e-6)), 0.0);
+        c += atten * (gl_LightSource[i].ambient.rgb + ndotl * gl_LightSource[i].diffuse.rgb) * color.rgb;
+    }
+
+    ivec3 cell = ivec3(gl_FragCoord.xy / tileSize, log(max(-eyePos.z, 1e-4)) * sliceScaleBias.x + sliceScaleBias.y);
+    cell = clamp(cell, ivec3(0), ivec3(15, 8, 23));
+    uvec2 range = texelFetch(clusterGrid, ivec2(cell.x + cell.y * 16, cell.z), 0).xy;
+    for (uint k = 0u; k < range.y; k++) {
+        uint slot = range.x + k;
+        int light = int(texelFetch(lightIndices, ivec2(int(slot % 1024u), int(slot / 1024u)), 0).r);
+        vec4 pos = texelFetch(lightData, ivec2(0, light), 0);
+        vec4 col = texelFetch(lightData, ivec2(1, light), 0);
+        vec3 kq = texelFetch(lightData, ivec2(2, light), 0).xyz;
+
+        vec3 L = pos.xyz - eyePos;
+        float d = length(L);
+        float atten = max(1.0 / (kq.x + kq.y * d + kq.z * d * d) - col.w, 0.0); // Reaches 0 at the range
+        c += atten * max(dot(n, L / max(d, 1e-6)), 0.0) * col.rgb * color.rgb;
+    }
+
+    vec4 result = clamp(vec4(c, color.a), 0.0, 1.0);
+    if (useTexture) result *= texture(diffuseMap, uv);
+    gl_FragColor = result;
+}
+)";
+
+GLuint CompileShader(GLenum type, const char* src) {
+    GLuint sh = glCreateShader(type);
+    glShaderSource(sh, 1, &src, nullptr);
+    glCompileShader(sh);
+
+    GLint ok = 0;
+    glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[2048];
+        glGetShaderInfoLog(sh, sizeof(log), nullptr, log);
+        std::cout << "Shader compile failed: " << log << std::endl;
+        glDeleteShader(sh);
+        return 0;
+    }
+    return sh;
+}
+
+// Attribute locations are bound before linking so every model VAO can share them
+GLuint LinkProgram(const char* vsSrc, const char* fsSrc, const std::vector<std::pair<GLuint, const char*>>& attribs) {
+    GLuint vs = CompileShader(GL_VERTEX_SHADER, vsSrc);
+    GLuint fs = CompileShader(GL_FRAGMENT_SHADER, fsSrc);
+    if (!vs || !fs) {
+        if (vs) glDeleteShader(vs);
+        if (fs) glDeleteShader(fs);
+        return 0;
+    }
+
+    GLuint prog = glCreateProgram();
+    glAttachShader(prog, vs);
+    glAttachShader(prog, fs);
+    for (const auto& a : attribs) glBindAttribLocation(prog, a.first, a.second);
+    glLinkProgram(prog);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    GLint ok = 0;
+    glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[2048];
+        glGetProgramInfoLog(prog, sizeof(log), nullptr, log);
+        std::cout << "Shader link failed: " << log << std::endl;
+        glDeleteProgram(prog);
+        return 0;
+    }
+    return prog;
+}
+
+bool HasGLVersion(int major, int minor) {
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int maj = 0, min = 0;
+    if (!version || sscanf(version, "%d.%d", &maj, &min) != 2) return false;
+    return maj > major || (maj == major && min >= minor);
+}
+
+void InitInstancing() {
+    if (!HasGLVersion(3, 3)) {
+        std::cout << "Instancing: needs OpenGL 3.3, using per-object draws" << std::endl;
+        return;
+    }
+    instancedProgram = LinkProgram(INSTANCED_VS, INSTANCED_FS, {
+        { ATTR_INSTANCE_MODEL, "instanceModel" },
+        { ATTR_INSTANCE_COLOR, "instanceColor" },
+    });
+    instancingSupported = instancedProgram != 0;
+
+    clusteredProgram = LinkProgram(CLUSTERED_VS, CLUSTERED_FS, {
+        { ATTR_INSTANCE_MODEL, "instanceModel" },
+        { ATTR_INSTANCE_COLOR, "instanceColor" },
+    });
+    clusteredSupported = instancingSupported && clusteredProgram != 0;
+    if (!clusteredSupported) return;
+
+    // Integer lookups (texelFetch only): nearest, no mipmaps
+    GLuint texs[3];
+    glGenTextures(3, texs);
+    clusterGridTex = texs[0]; lightIndexTex = texs[1]; lightDataTex = texs[2];
+    for (GLuint t : texs) {
+        glBindTexture(GL_TEXTURE_2D, t);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void InitOcclusion() {
+    if (!HasGLVersion(3, 0)) {
+        std::cout << "Occlusion Culling: needs OpenGL 3.0, frustum culling only" << std::endl;
+        return;
+    }
+    if (HasGLVersion(3, 3)) occlusionTarget = GL_ANY_SAMPLES_PASSED; // Stops counting at the first sample
+
+    // Unit cube [-1, 1]^3 as 12 triangles, scaled onto each box
+    static const int FACES[6][4] = { {0,2,3,1}, {4,5,7,6}, {0,1,5,4}, {2,6,7,3}, {0,4,6,2}, {1,3,7,5} };
+    std::vector<float> corners;
+    for (const auto& face : FACES) {
+        for (int k : { 0, 1, 2, 0, 2, 3 }) {
+            int c = face[k];
+            corners.push_back(c & 1 ? 1.0f : -1.0f);
+            corners.push_back(c & 2 ? 1.0f : -1.0f);
+            corners.push_back(c & 4 ? 1.0f : -1.0f);
+        }
+    }
+    glGenVertexArrays(1, &occlusionBoxVao);
+    glGenBuffers(1, &occlusionBoxVbo);
+    glBindVertexArray(occlusionBoxVao);
+    glBindBuffer(GL_ARRAY_BUFFER, occlusionBoxVbo);
+    glBufferData(GL_ARRAY_BUFFER, corners.size() * sizeof(float), corners.data(), GL_STATIC_DRAW);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, nullptr);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    occlusionSupported = true;
+}
+
+// Moves each light to its node's world position (+ offset). Bumps lightsVersion
+// only when one actually moved, so a still scene uploads nothing.
+void UpdateLights() {
+    for (SceneLight& light : sceneLights) {
+        int32_t i = scene.IndexOf(light.node);
+        if (i < 0) continue;
+        const float* world = scene.world[i].m;
+        float pos[3] = { world[12] + light.offset[0], world[13] + light.offset[1], world[14] + light.offset[2] };
+        if (memcmp(pos, light.position, sizeof(pos)) != 0) {
+            memcpy(light.position, pos, sizeof(pos));
+            lightsVersion++;
+        }
+    }
+}
+
+// GL_LIGHT1.. for the first maxFixedLights - 1 scene lights. Must run with the view
+// matrix current; positions are re-sent when a light or the view moved.
+void UploadFixedFunctionLights() {
+    static uint32_t uploadedVersion = 0;
+    static float uploadedView[16];
+    float view[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, view);
+    if (uploadedVersion == lightsVersion && memcmp(view, uploadedView, sizeof(view)) == 0) return;
+
+    int slots = (int)maxFixedLights - 1;
+    for (int k = 0; k < slots; k++) {
+        GLenum id = GL_LIGHT1 + k;
+        if (k >= (int)sceneLights.size()) { glDisable(id); continue; }
+        const SceneLight& light = sceneLights[k];
+        glEnable(id);
+        glLightfv(id, GL_DIFFUSE, light.color);
+        glLightfv(id, GL_POSITION, light.position);
+        glLightf(id, GL_CONSTANT_ATTENUATION, light.attenuation[0]);
+        glLightf(id, GL_LINEAR_ATTENUATION, light.attenuation[1]);
+        glLightf(id, GL_QUADRATIC_ATTENUATION, light.attenuation[2]);
+    }
+    uploadedVersion = lightsVersion;
+    memcpy(uploadedView, view, sizeof(view));
+}
+
+// Scene light uniforms of instancedProgram (must be bound). World space, so only
+// lightsVersion matters; uniforms persist in the program between frames.
+void UploadShaderLights() {
+    static uint32_t uploadedVersion = 0;
+    if (uploadedVersion == lightsVersion) return;
+    uploadedVersion = lightsVersion;
+
+    int count = std::min((int)sceneLights.size(), MAX_SHADER_LIGHTS);
+    std::vector<float> pos(count * 4), color(count * 4), atten(count * 3);
+    for (int k = 0; k < count; k++) {
+        memcpy(&pos[k * 4], sceneLights[k].position, 4 * sizeof(float));
+        memcpy(&color[k * 4], sceneLights[k].color, 4 * sizeof(float));
+        memcpy(&atten[k * 3], sceneLights[k].attenuation, 3 * sizeof(float));
+    }
+    glUniform1i(glGetUniformLocation(instancedProgram, "numSceneLights"), count);
+    if (count > 0) {
+        glUniform4fv(glGetUniformLocation(instancedProgram, "sceneLightPosition"), count, pos.data());
+        glUniform4fv(glGetUniformLocation(instancedProgram, "sceneLightColor"), count, color.data());
+        glUniform3fv(glGetUniformLocation(instancedProgram, "sceneLightAttenuation"), count, atten.data());
+    }
+    renderStats.stateChanges++;
+}
+
+// Slice of an eye-space depth: exponential, so near slices stay thin
+int ClusterSlice(float depth, float zNear, float zFar) {
+    int slice = (int)floorf(logf(depth / zNear) / logf(zFar / zNear) * CLUSTER_Z);
+    return std::max(0, std::min(CLUSTER_Z - 1, slice));
+}
+
+// Bins every light's range sphere into the cluster grid and uploads the three
+// lookup textures. Conservative: a light lands in every cluster its sphere's
+// screen rectangle and depth span touch. Rebuilt only when lights or camera moved.
+void BuildLightClusters() {
+    static uint32_t builtVersion = 0;
+    static float builtView[16], builtProj[16];
+    float view[16], proj[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, view);
+    glGetFloatv(GL_PROJECTION_MATRIX, proj);
+    if (builtVersion == lightsVersion && memcmp(view, builtView, sizeof(view)) == 0 && memcmp(proj, builtProj, sizeof(proj)) == 0) return;
+    builtVersion = lightsVersion;
+    memcpy(builtView, view, sizeof(view));
+    memcpy(builtProj, proj, sizeof(proj));
+
+    // Near/far back out of the gluPerspective matrix
+    float zNear = proj[14] / (proj[10] - 1.0f);
+    float zFar = proj[14] / (proj[10] + 1.0f);
+
+    const int numClusters = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+    std::vector<std::vector<uint32_t>> bins(numClusters);
+    std::vector<float> data;
+
+    int count = std::min((int)sceneLights.size(), MAX_CLUSTERED_LIGHTS);
+    for (int l = 0; l < count; l++) {
+        const SceneLight& light = sceneLights[l];
+        float intensity = std::max(light.color[0], std::max(light.color[1], light.color[2]));
+        const float* k = light.attenuation;
+        float reach = intensity / LIGHT_CUTOFF; // Attenuation denominator at the range
+        if (intensity <= 0.0f || k[0] >= reach) continue;
+
+        // Solve k2 d^2 + k1 d + k0 = reach
+        float range;
+        if (k[2] > 0.0f) range = (-k[1] + sqrtf(k[1] * k[1] - 4.0f * k[2] * (k[0] - reach))) / (2.0f * k[2]);
+        else if (k[1] > 0.0f) range = (reach - k[0]) / k[1];
+        else range = zFar * 2.0f; // No falloff: reaches everything on screen
+
+        float eye[3];
+        for (int r = 0; r < 3; r++) {
+            eye[r] = view[r] * light.position[0] + view[4 + r] * light.position[1] + view[8 + r] * light.position[2] + view[12 + r];
+        }
+        float depthNear = -eye[2] - range, depthFar = -eye[2] + range;
+        if (depthFar < zNear || depthNear > zFar) continue;
+
+        // Screen rectangle from the eye-space box around the sphere; full screen if it crosses the near plane
+        int x0 = 0, x1 = CLUSTER_X - 1, y0 = 0, y1 = CLUSTER_Y - 1;
+        if (depthNear > zNear) {
+            float minX = 1e30f, maxX = -1e30f, minY = 1e30f, maxY = -1e30f;
+            for (int corner = 0; corner < 8; corner++) {
+                float px = eye[0] + ((corner & 1) ? range : -range);
+                float py = eye[1] + ((corner & 2) ? range : -range);
+                float pz = eye[2] + ((corner & 4) ? range : -range);
+                float w = proj[3] * px + proj[7] * py + proj[11] * pz + proj[15];
+                float nx = (proj[0] * px + proj[4] * py + proj[8] * pz + proj[12]) / w;
+                float ny = (proj[1] * px + proj[5] * py + proj[9] * pz + proj[13]) / w;
+                minX = std::min(minX, nx); maxX = std::max(maxX, nx);
+                minY = std::min(minY, ny); maxY = std::max(maxY, ny);
+            }
+            if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f) continue;
+            x0 = std::max(0, (int)floorf((minX * 0.5f + 0.5f) * CLUSTER_X));
+            x1 = std::min(CLUSTER_X - 1, (int)floorf((maxX * 0.5f + 0.5f) * CLUSTER_X));
+            y0 = std::max(0, (int)floorf((minY * 0.5f + 0.5f) * CLUSTER_Y));
+            y1 = std::min(CLUSTER_Y - 1, (int)floorf((maxY * 0.5f + 0.5f) * CLUSTER_Y));
+        }
+        int z0 = ClusterSlice(std::max(depthNear, zNear), zNear, zFar);
+        int z1 = ClusterSlice(std::min(depthFar, zFar), zNear, zFar);
+
+        uint32_t index = data.size() / 12;
+        float texels[12] = {
+            eye[0], eye[1], eye[2], range,
+            light.color[0], light.color[1], light.color[2], LIGHT_CUTOFF / intensity,
+            k[0], k[1], k[2], 0.0f,
+        };
+        data.insert(data.end(), texels, texels + 12);
+        for (int z = z0; z <= z1; z++) {
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) bins[(z * CLUSTER_Y + y) * CLUSTER_X + x].push_back(index);
+            }
+        }
+    }
+
+    // Grid texel = (first index, count) into the flattened list
+    std::vector<uint32_t> grid(numClusters * 2);
+    std::vector<uint32_t> indices;
+    for (int c = 0; c < numClusters; c++) {
+        grid[c * 2 + 0] = indices.size();
+        grid[c * 2 + 1] = bins[c].size();
+        indices.insert(indices.end(), bins[c].begin(), bins[c].end());
+    }
+    clusterLightRefs = indices.size();
+    int indexRows = std::max<int>(1, (indices.size() + LIGHT_INDEX_TEX_WIDTH - 1) / LIGHT_INDEX_TEX_WIDTH);
+    indices.resize(indexRows * LIGHT_INDEX_TEX_WIDTH, 0);
+    int lightRows = std::max<int>(1, data.size() / 12);
+    data.resize(lightRows * 12, 0.0f);
+
+    glBindTexture(GL_TEXTURE_2D, clusterGridTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, CLUSTER_X * CLUSTER_Y, CLUSTER_Z, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, grid.data());
+    glBindTexture(GL_TEXTURE_2D, lightIndexTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, LIGHT_INDEX_TEX_WIDTH, indexRows, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, indices.data());
+    glBindTexture(GL_TEXTURE_2D, lightDataTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 3, lightRows, 0, GL_RGBA, GL_FLOAT, data.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Binds the cluster lookups to units 1-3 and sets the clustered program's uniforms (program must be bound)
+void BindLightClusters() {
+    float proj[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, proj);
+    float zNear = proj[14] / (proj[10] - 1.0f);
+    float zFar = proj[14] / (proj[10] + 1.0f);
+    float scale = CLUSTER_Z / logf(zFar / zNear);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, clusterGridTex);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, lightIndexTex);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, lightDataTex);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(clusteredProgram, "clusterGrid"), 1);
+    glUniform1i(glGetUniformLocation(clusteredProgram, "lightIndices"), 2);
+    glUniform1i(glGetUniformLocation(clusteredProgram, "lightData"), 3);
+    glUniform2f(glGetUniformLocation(clusteredProgram, "tileSize"), (float)windowWidth / CLUSTER_X, (float)windowHeight / CLUSTER_Y);
+    glUniform2f(glGetUniformLocation(clusteredProgram, "sliceScaleBias"), scale, -scale * logf(zNear));
+    renderStats.textureBinds += 3;
+    renderStats.stateChanges += 5;
+}
+
+// Draw sort key, most expensive state change in the highest bits so sorting
+// groups by shader, then texture, then mesh (VAO), then material (color).
+enum DrawShader : uint32_t {
+    SHADER_FIXED_FUNCTION = 0,
+    SHADER_INSTANCED = 1,
+    SHADER_CLUSTERED = 2,
+};
+
+enum DrawMaterial : uint32_t {
+    MATERIAL_DEFAULT = 0,
+    MATERIAL_HIGHLIGHT = 1,     // Selected (sub)tree
+};
+
+uint64_t MakeDrawKey(uint32_t shader, GLuint texture, GLuint mesh, uint32_t lod, uint32_t material) {
+    return ((uint64_t)(shader & 0xF) << 60) | ((uint64_t)(texture & 0xFFFFFF) << 36)
+         | ((uint64_t)(mesh & 0xFFFFF) << 16) | ((lod & 0xF) << 12) | (material & 0xFFF);
+}
+
+// Coarsest LOD whose simplification error covers at most LOD_PIXEL_ERROR pixels,
+// measured at the near side of the object's world bounding sphere. Hysteresis:
+// stepping coarser needs the error to be well under the limit, so an object that
+// sits on a boundary doesn't flip between levels every frame.
+uint32_t SelectLod(uint32_t i, const float eye[3]) {
+    const Model* m = scene.model[i];
+    uint32_t levels = m->lods.size();
+    if (!useMeshLods || levels < 2) return 0;
+
+    const float* w = scene.world[i].m;
+    float maxScale = 0.0f, dist2 = 0.0f;
+    for (int r = 0; r < 3; r++) {
+        float c = w[12 + r] + w[r] * m->center[0] + w[4 + r] * m->center[1] + w[8 + r] * m->center[2];
+        dist2 += (c - eye[r]) * (c - eye[r]);
+        maxScale = std::max(maxScale, w[r * 4 + 0] * w[r * 4 + 0] + w[r * 4 + 1] * w[r * 4 + 1] + w[r * 4 + 2] * w[r * 4 + 2]);
+    }
+    float scale = sqrt(maxScale);
+    float dist = std::max(sqrt(dist2) - m->radius * scale, 0.1f); // Not closer than the near plane
+    float pixelsPerUnit = scale * lodPixelScale / dist;
+
+    uint32_t lod = std::min<uint32_t>(scene.lod[i], levels - 1);
+    while (lod > 0 && m->lods[lod].error * pixelsPerUnit > LOD_PIXEL_ERROR) lod--;
+    while (lod + 1 < levels && m->lods[lod + 1].error * pixelsPerUnit <= LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS)) lod++;
+    scene.lod[i] = lod;
+    return lod;
+}
+
+struct DrawSortItem {
+    uint64_t key;
+    uint32_t node;          // Or STATIC_BATCH_ITEM | batch index
+};
+const uint32_t STATIC_BATCH_ITEM = 0x80000000u;
+
+// Stable LSD radix sort on the key, one byte per pass. Bytes that are equal in
+// every key (shader bits, unused texture/mesh bits) are skipped, so a typical
+// scene costs two or three linear passes instead of a comparison sort.
+void RadixSortDrawItems(std::vector<DrawSortItem>& items, std::vector<DrawSortItem>& scratch) {
+    if (items.size() < 2) return;
+    uint64_t varying = 0;
+    for (const DrawSortItem& it : items) varying |= it.key ^ items[0].key;
+
+    scratch.resize(items.size());
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xFF) == 0) continue;
+        size_t offsets[257] = {};
+        for (const DrawSortItem& it : items) offsets[((it.key >> shift) & 0xFF) + 1]++;
+        for (int b = 0; b < 256; b++) offsets[b + 1] += offsets[b];
+        for (const DrawSortItem& it : items) scratch[offsets[(it.key >> shift) & 0xFF]++] = it;
+        items.swap(scratch);
+    }
+}
+
+// Records a command per visible object on the job system, sorted by state key.
+// Keys are sorted as compact (key, node) items and the commands are then written
+// in final order; ties keep scene order, so the list is the same every frame.
+// After this the GL thread only walks drawList. objects is visibleObjects, or the
+// occlusion pass's late additions; batches (static batch indices) sort in with them.
+void BuildDrawList(uint32_t shader, const std::vector<uint32_t>& objects, const std::vector<uint32_t>& batches) {
+    static std::vector<DrawSortItem> order, scratch;
+    static const float IDENTITY[16] = { 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+    float pulse = HighlightPulse();
+    float eye[3];
+    CameraEye(eye);
+    uint32_t count = objects.size() + batches.size();
+    bool instanced = shader != SHADER_FIXED_FUNCTION;
+
+    order.resize(count);
+    for (uint32_t k = 0; k < batches.size(); k++) {
+        const Model& mesh = staticBatches[batches[k]]->mesh;
+        order[objects.size() + k] = { MakeDrawKey(shader, mesh.texture ? mesh.texture->id : 0, mesh.vao, 0, MATERIAL_DEFAULT), STATIC_BATCH_ITEM | batches[k] };
+    }
+    frameJobs.ParallelFor(objects.size(), FRAME_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t k = begin; k < end; k++) {
+            uint32_t i = objects[k];
+            const Model* m = scene.model[i];
+            // Instances carry their own color, so material only splits fixed-function runs
+            uint32_t material = (!instanced && IsSelected(i)) ? MATERIAL_HIGHLIGHT : MATERIAL_DEFAULT;
+            order[k] = { MakeDrawKey(shader, m->texture ? m->texture->id : 0, m->vao, SelectLod(i, eye), material), i };
+        }
+    });
+    RadixSortDrawItems(order, scratch);
+
+    drawList.resize(count);
+    frameJobs.ParallelFor(count, FRAME_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t k = begin; k < end; k++) {
+            uint32_t i = order[k].node;
+            DrawCommand& cmd = drawList[k];
+            cmd.key = order[k].key;
+            if (i & STATIC_BATCH_ITEM) {
+                cmd.model = &staticBatches[i & ~STATIC_BATCH_ITEM]->mesh;
+                cmd.lod = 0;
+                memcpy(cmd.instance.model, IDENTITY, sizeof(cmd.instance.model));
+                for (float& c : cmd.instance.color) c = 1.0f;
+                continue;
+            }
+            cmd.model = scene.model[i];
+            cmd.lod = (order[k].key >> 12) & 0xF;
+            memcpy(cmd.instance.model, scene.world[i].m, sizeof(cmd.instance.model));
+            ObjectColor(i, pulse, cmd.instance.color);
+        }
+    });
+}
+
+// Fixed-function path: one matrix push + draw per command. GL state is shadowed
+// here so a bind/enable/color is only issued when it differs from the last one.
+void DrawObjectsLegacy() {
+    int texturing = -1;             // Unknown at frame start: first command always sets it
+    GLuint boundTexture = 0;
+    GLuint boundVao = 0;
+    float color[3] = { -1.0f, -1.0f, -1.0f };
+
+    for (const DrawCommand& cmd : drawList) {
+        const Model* m = cmd.model;
+        glPushMatrix();
+        glMultMatrixf(cmd.instance.model); // Cached parent world * translate * rotate(X, Y, Z) * scale
+
+        if (memcmp(color, cmd.instance.color, sizeof(color)) != 0) {
+            memcpy(color, cmd.instance.color, sizeof(color));
+            glColor3fv(color);
+            renderStats.stateChanges++;
+        } else renderStats.skippedBinds++;
+
+        bool textured = m->texture && m->texture->id != 0;
+        if ((int)textured != texturing) {
+            if (textured) glEnable(GL_TEXTURE_2D);
+            else glDisable(GL_TEXTURE_2D);
+            texturing = textured;
+            renderStats.stateChanges++;
+        } else renderStats.skippedBinds++;
+
+        if (textured) {
+            if (m->texture->id != boundTexture) {
+                glBindTexture(GL_TEXTURE_2D, m->texture->id);
+                boundTexture = m->texture->id;
+                renderStats.textureBinds++;
+            } else renderStats.skippedBinds++;
+        }
+
+        // One draw call per object (buffers were uploaded in GetModel)
+        if (m->vao != boundVao) {
+            glBindVertexArray(m->vao);
+            boundVao = m->vao;
+            renderStats.meshBinds++;
+        } else renderStats.skippedBinds++;
+
+        if (m->ibo) {
+            const MeshLod& lod = m->lods[cmd.lod];
+            glDrawElements(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, (void*)(lod.indexOffset * sizeof(unsigned int)));
+            renderStats.triangles += lod.indexCount / 3;
+        } else {
+            glDrawArrays(GL_TRIANGLES, 0, m->vertexCount);
+            renderStats.triangles += m->vertexCount / 3;
+        }
+        renderStats.drawCalls++;
+
+        glPopMatrix();
+    }
+    glBindVertexArray(0);
+}
+
+// Instanced path: the sorted list is a run of commands per Model and LOD, one draw per run.
+// Runs sharing a texture are adjacent, so the bind and useTexture uniform usually carry over.
+// Scene lights come either per vertex (instancedProgram) or from the light clusters.
+void DrawObjectsInstanced(bool clustered) {
+    static std::vector<InstanceData> instances;
+
+    GLuint program = clustered ? clusteredProgram : instancedProgram;
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "numLights"), 1); // GL_LIGHT0
+    if (clustered) BindLightClusters();
+    else UploadShaderLights();
+    glUniform1i(glGetUniformLocation(program, "diffuseMap"), 0);
+    GLint useTextureLoc = glGetUniformLocation(program, "useTexture");
+    renderStats.stateChanges += 3;
+
+    int useTexture = -1;
+    GLuint boundTexture = 0;
+    GLuint boundVao = 0;
+    for (size_t run = 0; run < drawList.size();) {
+        Model* m = drawList[run].model;
+        uint32_t lodIndex = drawList[run].lod;
+        size_t end = run;
+        instances.clear();
+        for (; end < drawList.size() && drawList[end].model == m && drawList[end].lod == lodIndex; end++) {
+            instances.push_back(drawList[end].instance);
+        }
+        run = end;
+        if (!m->instanceVBO) continue;
+
+        bool textured = m->texture && m->texture->id != 0;
+        if ((int)textured != useTexture) {
+            glUniform1i(useTextureLoc, textured);
+            useTexture = textured;
+            renderStats.stateChanges++;
+        } else renderStats.skippedBinds++;
+
+        if (textured) {
+            if (m->texture->id != boundTexture) {
+                glBindTexture(GL_TEXTURE_2D, m->texture->id);
+                boundTexture = m->texture->id;
+                renderStats.textureBinds++;
+            } else renderStats.skippedBinds++;
+        }
+
+        // Orphan + refill so the driver doesn't stall on last frame's data
+        glBindBuffer(GL_ARRAY_BUFFER, m->instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+
+        // Runs of the same mesh at another LOD follow each other and keep the VAO
+        if (m->vao != boundVao) {
+            glBindVertexArray(m->vao);
+            boundVao = m->vao;
+            renderStats.meshBinds++;
+        } else renderStats.skippedBinds++;
+
+        if (m->ibo) {
+            const MeshLod& lod = m->lods[lodIndex];
+            glDrawElementsInstanced(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, (void*)(lod.indexOffset * sizeof(unsigned int)), instances.size());
+            renderStats.triangles += lod.indexCount / 3 * instances.size();
+        } else {
+            glDrawArraysInstanced(GL_TRIANGLES, 0, m->vertexCount, instances.size());
+            renderStats.triangles += m->vertexCount / 3 * instances.size();
+        }
+        renderStats.drawCalls++;
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+}
+
+// Resident set size from /proc (0 where that isn't available)
+size_t ResidentBytes() {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long pages = 0, resident = 0;
+    int n = fscanf(f, "%lu %lu", &pages, &resident);
+    fclose(f);
+    return n == 2 ? resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+// Profiler overlay (P): smoothed frame and scope times plus this frame's counters,
+// drawn with fixed-function state over the finished scene
+void DrawProfilerHud() {
+    std::vector<std::string> lines;
+    char line[160];
+    float frameMs = profiler.FrameMs();
+    snprintf(line, sizeof(line), "Frame %6.2f ms (%4.0f fps)   CPU %6.2f ms", frameMs, frameMs > 0.0f ? 1000.0f / frameMs : 0.0f, profiler.CpuFrameMs());
+    lines.push_back(line);
+    for (const ProfileStat& s : profiler.CpuStats()) {
+        snprintf(line, sizeof(line), "  cpu %-14s %7.3f ms", s.name, s.avgMs);
+        lines.push_back(line);
+    }
+    for (const ProfileStat& s : profiler.GpuStats()) {
+        snprintf(line, sizeof(line), "  gpu %-14s %7.3f ms", s.name, s.avgMs);
+        lines.push_back(line);
+    }
+    if (!profiler.GpuTimers()) lines.push_back("  gpu timers unavailable");
+
+    snprintf(line, sizeof(line), "Draws %d  Tris %d  Texture binds %d  Mesh binds %d",
+             renderStats.drawCalls, renderStats.triangles, renderStats.textureBinds, renderStats.meshBinds);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "State changes %d (%d skipped)  Lights %zu", renderStats.stateChanges, renderStats.skippedBinds, sceneLights.size());
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "Objects %zu visible / %d culled / %d occluded (%d queries)",
+             visibleObjects.size(), culledCount, renderStats.occluded, renderStats.occlusionQueries);
+    lines.push_back(line);
+    if (useStaticBatching) {
+        snprintf(line, sizeof(line), "Static batches %zu drawn / %zu (%d objects, %zu pulled out)",
+                 visibleBatches.size(), staticBatches.size(), batchedNodeCount, pulledNodes.size());
+        lines.push_back(line);
+    }
+    const double MB = 1024.0 * 1024.0;
+    snprintf(line, sizeof(line), "Memory: GPU buffers %.1f MB, textures %.1f MB   RSS %.1f MB",
+             gpuBufferBytes / MB, gpuTextureBytes / MB, ResidentBytes() / MB);
+    lines.push_back(line);
+    snprintf(line, sizeof(line), "Assets: %zu models, %zu textures live", modelRegistry.Live(), textureRegistry.Live());
+    lines.push_back(line);
+
+    const int LINE_HEIGHT = 15, GLYPH_WIDTH = 8, MARGIN = 6;
+    size_t columns = 0;
+    for (const std::string& l : lines) columns = std::max(columns, l.size());
+    int top = windowHeight - MARGIN;
+    int bottom = top - (int)lines.size() * LINE_HEIGHT - 2 * MARGIN;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_COLOR_MATERIAL); // Or glColor below would rewrite the scene's material
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, windowWidth, 0, windowHeight);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
 
-    if (isAnimated) {
-        obj->spinAnimation = true;
-        obj->spinSpeed = 1.0f;
+    glColor4f(0.0f, 0.0f, 0.0f, 0.6f);
+    glRecti(MARGIN, bottom, 3 * MARGIN + (int)columns * GLYPH_WIDTH, top);
+    glColor3f(0.9f, 1.0f, 0.6f);
+    for (size_t k = 0; k < lines.size(); k++) {
+        glRasterPos2i(2 * MARGIN, top - MARGIN - (int)(k + 1) * LINE_HEIGHT + 3);
+        for (char c : lines[k]) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
     }
 
-    sceneObjects.push_back(obj);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
 }
 
-void LoadScene() {
-    //              Name             File                Pos (x,y,z)               Rot (0,0,0)             Scale (1,1,1)      Anim?
-    // --------------------------------------------------------------------------------------------------------------------------
-    AddObj("big_sofa",      "big_sofa.obj",      -1.854, 0.030, 0.198,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("bookshelf",     "bookshelf.obj",     -2.053, -1.771, 0.030,    0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("cactus",        "cactus.obj",        -0.155, -0.131, 0.503,    0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("carpet",        "carpet.obj",        -0.039, 0.244, 0.046,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    
-    // Clock needs animation = true
-    AddObj("clock",         "clock.obj",         -2.262, -1.811, 2.082,    0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      true);
-    
-    AddObj("curtain_left",  "curtain_left.obj",  -0.978, 2.213, 1.592,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("curtain_right", "curtain_right.obj",  0.619, 2.213, 1.592,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("floor",         "floor.obj",         -0.123, 0.011, 0.004,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("lamp",          "lamp.obj",          -1.829, 1.863, 0.088,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("shelf",         "shelf.obj",         -2.181, 0.072, 1.498,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("sofa",          "sofa.obj",          -0.077, 1.839, 0.336,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("table",         "table.obj",         -0.285, -0.104, 0.048,    0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("tv",            "tv.obj",             2.026, 0.132, 0.720,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("wall_left",     "wall_left.obj",     -2.321, 0.001, 1.404,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("wall_right",    "wall_right.obj",    -0.110, 2.372, 1.402,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("window_left",   "window_left.obj",   -0.498, 2.290, 1.604,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
-    AddObj("window_right",  "window_right.obj",   0.349, 2.290, 1.604,     0.0, 0.0, 0.0,        1.0, 1.0, 1.0,      false);
+// ==========================================
+// 8. GLUT FUNCTIONS
+// ==========================================
+// Swap interval through GLX_EXT/MESA/SGI_swap_control, whichever the driver exposes
+void SetVSync(bool on) {
+    typedef void (*SwapIntervalEXT)(Display*, GLXDrawable, int);
+    typedef int (*SwapIntervalMESA)(unsigned int);
+    typedef int (*SwapIntervalSGI)(int);
 
-    // Set default selection to the first object (big_sofa)
-    if(!sceneObjects.empty()) {
-        selectedObject = sceneObjects[0]; 
+    Display* dpy = glXGetCurrentDisplay();
+    GLXDrawable drawable = glXGetCurrentDrawable();
+    if (auto ext = (SwapIntervalEXT)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalEXT")) {
+        if (dpy && drawable) { ext(dpy, drawable, on ? 1 : 0); return; }
+    }
+    if (auto mesa = (SwapIntervalMESA)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalMESA")) {
+        mesa(on ? 1 : 0);
+        return;
+    }
+    if (auto sgi = (SwapIntervalSGI)glXGetProcAddressARB((const GLubyte*)"glXSwapIntervalSGI")) {
+        sgi(on ? 1 : 0);
     }
 }
 
-// ==========================================
-// 6. GLUT FUNCTIONS
-// ==========================================
-void display() {
+// One frame of the scene into the bound framebuffer (the window, or the offscreen
+// target of --render)
+void RenderFrame() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
 
     // ORBIT CAMERA
-    float camX = cameraDist * sin(cameraAngle);
-    float camY = cameraDist * cos(cameraAngle); 
-    gluLookAt(camX, camY, cameraHeight,  0, 0, 0,  0, 0, 1);
-
-    // DYNAMIC LIGHTS
-    for (Object* obj : sceneObjects) {
-        if (obj->name == "tv") {
-            GLfloat blueColor[] = { 0.2f, 0.2f, 1.0f, 1.0f };
-            GLfloat lightPos[]  = { obj->x, obj->y, obj->z + 0.5f, 1.0f }; 
-            glLightfv(GL_LIGHT1, GL_DIFFUSE, blueColor);
-            glLightfv(GL_LIGHT1, GL_POSITION, lightPos);
-            glLightf(GL_LIGHT1, GL_CONSTANT_ATTENUATION, 1.0f);
-            glLightf(GL_LIGHT1, GL_LINEAR_ATTENUATION, 0.2f);
-            glLightf(GL_LIGHT1, GL_QUADRATIC_ATTENUATION, 0.05f);
-        }
-        
-        if (obj->name == "lamp") {
-            GLfloat orangeColor[] = { 1.0f, 0.7f, 0.2f, 1.0f };
-            GLfloat lightPos[]    = { obj->x, obj->y, obj->z + 1.5f, 1.0f }; 
-            glLightfv(GL_LIGHT2, GL_DIFFUSE, orangeColor);
-            glLightfv(GL_LIGHT2, GL_POSITION, lightPos);
-            glLightf(GL_LIGHT2, GL_CONSTANT_ATTENUATION, 1.0f);
-            glLightf(GL_LIGHT2, GL_LINEAR_ATTENUATION, 0.1f);
-            glLightf(GL_LIGHT2, GL_QUADRATIC_ATTENUATION, 0.02f);
-        }
+    float eye[3];
+    CameraEye(eye);
+    gluLookAt(eye[0], eye[1], eye[2],  0, 0, 0,  0, 0, 1);
+
+    {
+        ProfileScope scope("Transforms");
+        UpdateSceneBvh(UpdateSceneTransforms());
+        UpdateStaticBatches();
+    }
+
+    // DYNAMIC LIGHTS (declared in the scene file, follow their nodes)
+    {
+        ProfileScope scope("Lights");
+        UpdateLights();
     }
 
     glEnable(GL_LIGHTING);
 
     // Draw Objects
-    for (Object* obj : sceneObjects) {
-        if (!obj->model || !obj->model->loaded) continue;
-
-        glPushMatrix();
-        
-        // Transforms
-        glTranslatef(obj->x, obj->y, obj->z);
-        glRotatef(obj->rx, 1, 0, 0);
-        glRotatef(obj->ry, 0, 1, 0);
-        glRotatef(obj->rz, 0, 0, 1);
-        glScalef(obj->sx, obj->sy, obj->sz);
-
-        // Selection Highlight
-        if (obj == selectedObject) {
-            float pulse = (sin(glutGet(GLUT_ELAPSED_TIME) * 0.005f) + 1.0f) * 0.2f + 0.8f;
-            glColor3f(pulse, pulse, 0.5f); 
-        } else {
-            glColor3f(1, 1, 1);
-        }
-
-        if (obj->model->textureID != 0) {
-            glEnable(GL_TEXTURE_2D);
-            glBindTexture(GL_TEXTURE_2D, obj->model->textureID);
-        } else {
-            glDisable(GL_TEXTURE_2D);
-        }
-
-        glBegin(GL_TRIANGLES);
-        int numVerts = obj->model->vertices.size() / 3;
-        for (int i = 0; i < numVerts; i++) {
-            if (!obj->model->normals.empty())
-                glNormal3f(obj->model->normals[3*i+0], obj->model->normals[3*i+1], obj->model->normals[3*i+2]);
-            if (!obj->model->texcoords.empty())
-                glTexCoord2f(obj->model->texcoords[2*i+0], obj->model->texcoords[2*i+1]);
-            glVertex3f(obj->model->vertices[3*i+0], obj->model->vertices[3*i+1], obj->model->vertices[3*i+2]);
-        }
-        glEnd();
-
-        glPopMatrix();
+    bool instanced = useInstancing && instancingSupported;
+    bool clustered = instanced && useClusteredLighting && clusteredSupported;
+    uint32_t shader = clustered ? SHADER_CLUSTERED : instanced ? SHADER_INSTANCED : SHADER_FIXED_FUNCTION;
+    renderStats = RenderStats();
+    {
+        ProfileScope scope("Cull");
+        CullObjects();
+        CullOccluded();
     }
+    {
+        ProfileScope scope("Draw list");
+        BuildDrawList(shader, visibleObjects, visibleBatches);
+    }
+    {
+        ProfileScope scope("Light setup");
+        GpuProfileScope gpu("Light setup");
+        if (clustered) BuildLightClusters();
+        else if (!instanced) UploadFixedFunctionLights();
+    }
+    {
+        ProfileScope scope("Draw");
+        GpuProfileScope gpu("Draw");
+        if (instanced) DrawObjectsInstanced(clustered);
+        else DrawObjectsLegacy();
+    }
+    {
+        ProfileScope scope("Occlusion");
+        GpuProfileScope gpu("Occlusion");
+        QueryOccluded();
+    }
+    if (showProfilerHud) {
+        ProfileScope scope("HUD");
+        GpuProfileScope gpu("HUD");
+        DrawProfilerHud();
+    }
+}
 
+void display() {
+    profiler.BeginFrame();
+    RenderFrame();
     glutSwapBuffers();
+    if (cameraRecordFile) {
+        fprintf(cameraRecordFile, "%.4f %.5f %.4f %.4f\n", NowSeconds() - cameraRecordStart, cameraAngle, cameraHeight, cameraDist);
+        fflush(cameraRecordFile);
+    }
+    profiler.EndFrame(renderStats, visibleObjects.size(), gpuBufferBytes + gpuTextureBytes);
 }
 
 void keyboard(unsigned char key, int x, int y) {
-    if (!selectedObject) return;
+    // CTRL+R (18): Reload the scene (also works when it came up empty)
+    if (key == 18) {
+        ReloadScene();
+        glutPostRedisplay();
+        return;
+    }
+
+    int32_t sel = scene.IndexOf(selectedObject);
+    if (sel < 0) return;
     float speed = 0.2f;
     float rSpeed = 5.0f;
 
     switch(key) {
         case 27: exit(0); break; // ESC
         case 9: // TAB
-            selectionIndex = (selectionIndex + 1) % sceneObjects.size();
-            selectedObject = sceneObjects[selectionIndex];
-            std::cout << "Selected: " << selectedObject->name << std::endl;
+            selectionIndex = (selectionIndex + 1) % scene.Count();
+            selectedObject = scene.HandleOf(selectionIndex);
+            selectionTime = NowSeconds();
+            std::cout << "Selected: " << scene.name[selectionIndex] << std::endl;
             break;
         
         case ' ': isClockAnimating = !isClockAnimating; break; // Space: Pause Clock
+
+        case 'i':
+            useInstancing = !useInstancing;
+            std::cout << "Instancing: " << (useInstancing && instancingSupported ? "ON" : "OFF") << std::endl;
+            break;
+
+        case 'v':
+            useVSync = !useVSync;
+            SetVSync(useVSync);
+            std::cout << "VSync: " << (useVSync ? "ON" : "OFF (frame cap " + std::to_string(frameCap) + ")") << std::endl;
+            break;
+
+        case 'm':
+            useSimdTransforms = !useSimdTransforms;
+            std::cout << "Transforms: " << (useSimdTransforms ? SIMD_NAME : "scalar reference")
+                      << " (kernels differ by " << CompareTransformKernels() << ")" << std::endl;
+            break;
+
+        case 'b':
+            std::cout << "Draw stats: " << renderStats.drawCalls << " draws, " << renderStats.triangles << " tris, " << renderStats.textureBinds << " texture binds, "
+                      << renderStats.meshBinds << " mesh binds, " << renderStats.stateChanges << " state changes, "
+                      << renderStats.skippedBinds << " redundant skipped (" << drawList.size() << " commands)" << std::endl;
+            break;
+
+        case 'l':
+            useClusteredLighting = !useClusteredLighting;
+            std::cout << "Clustered Lighting: " << (useClusteredLighting && clusteredSupported ? "ON" : "OFF")
+                      << " (" << sceneLights.size() << " lights, " << clusterLightRefs << " cluster entries)" << std::endl;
+            break;
+
+        case 'o': {
+            useMeshLods = !useMeshLods;
+            int reduced = 0;
+            for (const DrawCommand& cmd : drawList) reduced += cmd.lod > 0;
+            std::cout << "Mesh LODs: " << (useMeshLods ? "ON" : "OFF") << " (" << reduced << " of " << drawList.size()
+                      << " objects drawn simplified last frame)" << std::endl;
+            break;
+        }
+
+        case 'k':
+            useBvhCulling = !useBvhCulling;
+            std::cout << "BVH Culling: " << (useBvhCulling ? "ON" : "OFF (linear scan)") << " (" << sceneBvhNodes.size() << " objects in BVH)" << std::endl;
+            break;
+
+        case 'x':
+            useOcclusionCulling = !useOcclusionCulling;
+            std::cout << "Occlusion Culling: " << (useOcclusionCulling && occlusionSupported ? "ON" : "OFF") << " ("
+                      << renderStats.occluded << " occluded, " << renderStats.occlusionQueries << " queries last frame)" << std::endl;
+            break;
+
+        case 'z':
+            useStaticBatching = !useStaticBatching;
+            std::cout << "Static Batching: " << (useStaticBatching ? "ON" : "OFF") << " (" << batchedNodeCount << " objects in "
+                      << staticBatches.size() << " batches, " << pulledNodes.size() << " waiting to rejoin)" << std::endl;
+            break;
+
+        case 'p':
+            showProfilerHud = !showProfilerHud;
+            break;
+
+        // CTRL+P (16): Write the profiler's buffer as a Chrome trace
+        case 16:
+            if (profiler.WriteTrace("profile.json")) std::cout << "Profile written to profile.json (open in chrome://tracing or Perfetto)" << std::endl;
+            else std::cout << "Could not write profile.json" << std::endl;
+            break;
+
+        case 'c':
+            useFrustumCulling = !useFrustumCulling;
+            std::cout << "Frustum Culling: " << (useFrustumCulling ? "ON" : "OFF") << " (" << culledCount << " culled last frame)" << std::endl;
+            break;
         
+        // CTRL+S (19): Save a binary snapshot next to the loaded scene
+        case 19: {
+            std::string path = currentScenePath;
+            size_t dot = path.find_last_of('.');
+            if (dot != std::string::npos && path.find('/', dot) == std::string::npos) path.erase(dot);
+            SaveSceneBinary(path + ".scnb");
+            break;
+        }
+
         // ENTER KEY (13): Toggle 360 Degree Room View
         case 13: 
             isRoomSpinning = !isRoomSpinning; 
@@ -310,26 +5988,50 @@ void keyboard(unsigned char key, int x, int y) {
             break;
 
         // Position
-        case 'q': selectedObject->x += speed; break;
-        case 'a': selectedObject->x -= speed; break;
-        case 'w': selectedObject->y += speed; break;
-        case 's': selectedObject->y -= speed; break;
-        case 'e': selectedObject->z += speed; break;
-        case 'd': selectedObject->z -= speed; break;
+        case 'q': scene.posX[sel] += speed; break;
+        case 'a': scene.posX[sel] -= speed; break;
+        case 'w': scene.posY[sel] += speed; break;
+        case 's': scene.posY[sel] -= speed; break;
+        case 'e': scene.posZ[sel] += speed; break;
+        case 'd': scene.posZ[sel] -= speed; break;
 
         // Rotation
-        case 'r': selectedObject->rx += rSpeed; break;
-        case 'f': selectedObject->rx -= rSpeed; break;
-        case 't': selectedObject->ry += rSpeed; break;
-        case 'g': selectedObject->ry -= rSpeed; break;
-        case 'y': selectedObject->rz += rSpeed; break;
-        case 'h': selectedObject->rz -= rSpeed; break;
+        case 'r': scene.rotX[sel] += rSpeed; break;
+        case 'f': scene.rotX[sel] -= rSpeed; break;
+        case 't': scene.rotY[sel] += rSpeed; break;
+        case 'g': scene.rotY[sel] -= rSpeed; break;
+        case 'y': scene.rotZ[sel] += rSpeed; break;
+        case 'h': scene.rotZ[sel] -= rSpeed; break;
         
         // Scale
-        case 'u': selectedObject->sx += 0.05; selectedObject->sy += 0.05; selectedObject->sz += 0.05; break;
-        case 'j': selectedObject->sx -= 0.05; selectedObject->sy -= 0.05; selectedObject->sz -= 0.05; break;
+        case 'u': scene.sclX[sel] += 0.05; scene.sclY[sel] += 0.05; scene.sclZ[sel] += 0.05; break;
+        case 'j': scene.sclX[sel] -= 0.05; scene.sclY[sel] -= 0.05; scene.sclZ[sel] -= 0.05; break;
+    }
+
+    // Any of the transform keys above invalidates the cached matrix
+    if (key && strchr("qawsedrftgyhuj", key)) {
+        MarkDirty(sel);
+        PullFromStaticBatch(sel, true);
     }
     glutPostRedisplay();
+    WakeIdle();
+}
+
+// Left click selects the object under the cursor (same as TAB landing on it)
+void mouse(int button, int state, int x, int y) {
+    if (button != GLUT_LEFT_BUTTON || state != GLUT_DOWN) return;
+    float origin[3], dir[3];
+    ScreenRay(x, y, origin, dir);
+    float t = 1.0f;
+    int32_t hit = PickObject(origin, dir, t);
+    if (hit < 0) return;
+
+    selectionIndex = hit;
+    selectedObject = scene.HandleOf(hit);
+    selectionTime = NowSeconds();
+    std::cout << "Selected: " << scene.name[hit] << std::endl;
+    glutPostRedisplay();
+    WakeIdle();
 }
 
 void specialKeys(int key, int x, int y) {
@@ -342,68 +6044,909 @@ void specialKeys(int key, int x, int y) {
     glutPostRedisplay();
 }
 
-void idle() {
+bool IsAnimating() {
+    if (isRoomSpinning || IsHighlightPulsing()) return true;
+    if (isClockAnimating) {
+        for (uint8_t spin : scene.spinning) {
+            if (spin) return true;
+        }
+    }
+    return false;
+}
+
+// Advances every animation by dt seconds
+void Update(float dt) {
+    ProfileScope scope("Animation");
     // 1. Clock Animation (Updated: Rotate -X)
     if (isClockAnimating) {
-        for (Object* obj : sceneObjects) {
-            if (obj->spinAnimation) {
-                obj->rx -= obj->spinSpeed; 
-            }
+        frameJobs.ParallelFor(scene.Count(), FRAME_JOB_GRAIN, [dt](uint32_t begin, uint32_t end) {
+            if (useSimdTransforms) AnimateSpinsSimd(begin, end, dt);
+            else AnimateSpinsScalar(begin, end, dt);
+        });
+        for (uint32_t i = 0; i < scene.Count(); i++) {
+            if (scene.spinning[i]) MarkDirty(i);
         }
     }
 
     // 2. Room 360 Spin Animation (New!)
     if (isRoomSpinning) {
-        cameraAngle += 0.005f; // Adjust this number to change spin speed
+        cameraAngle += ROOM_SPIN_SPEED * dt; // Adjust ROOM_SPIN_SPEED to change spin speed
+    }
+}
+
+void idle() {
+    // 0. Finish any assets the loader threads have ready (PostRedisplay is done per asset)
+    PumpUploadQueue();
+
+    bool animating = IsAnimating();
+    if (!animating) {
+        // Nothing moves: stop polling once the loaders are done, GLUT then sleeps until input
+        if (pendingAssets == 0 && pendingReloads == 0) {
+            glutPostRedisplay(); // Final still frame (e.g. highlight back to steady)
+            glutIdleFunc(nullptr);
+            idleRegistered = false;
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        lastUpdateTime = NowSeconds();
+        return;
+    }
+
+    // Frame cap: wait out the rest of this frame's slot instead of spinning
+    double now = NowSeconds();
+    if (frameCap > 0 && !useVSync) {
+        double wait = lastFrameTime + 1.0 / frameCap - now;
+        if (wait > 0.0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            now = NowSeconds();
+        }
     }
 
+    float dt = std::min((float)(now - lastUpdateTime), MAX_TIMESTEP);
+    lastUpdateTime = now;
+    lastFrameTime = now;
+
+    Update(dt);
     glutPostRedisplay();
 }
 
+void WakeIdle() {
+    if (idleRegistered) return;
+    idleRegistered = true;
+    lastUpdateTime = NowSeconds();
+    glutIdleFunc(idle);
+}
+
 void init() {
     glEnable(GL_DEPTH_TEST);
     
     // LIGHTING SETUP
     glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0); // White general
-    glEnable(GL_LIGHT1); // TV Blue
-    glEnable(GL_LIGHT2); // Lamp Orange
+    glEnable(GL_LIGHT0); // White general (scene lights take GL_LIGHT1 and up)
+    glGetIntegerv(GL_MAX_LIGHTS, &maxFixedLights);
 
     glEnable(GL_COLOR_MATERIAL); 
     glDisable(GL_CULL_FACE); 
     glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+    glEnable(GL_NORMALIZE); // Scaled objects would light darker; the shaders and static batches use unit normals
 
     GLfloat light_pos[] = { 5.0, 5.0, 10.0, 1.0 };
     glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
     
     glClearColor(0.1f, 0.1f, 0.15f, 1.0f);
+
+    // Compressed formats the driver accepts (checked by the KTX loader threads)
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &numFormats);
+    compressedFormats.resize(numFormats);
+    if (numFormats > 0) glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, compressedFormats.data());
+
+    InitInstancing(); // Before any model upload: VAOs get instance attributes only if supported
+    InitOcclusion();
+    profiler.EnableGpuTimers(HasGLVersion(3, 3)); // GL_TIMESTAMP queries (ARB_timer_query)
 }
 
 void reshape(int w, int h) {
     if (h == 0) h = 1;
+    windowWidth = w;
+    windowHeight = h;
     glViewport(0, 0, w, h);
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(45.0, (float)w / h, 0.1, 100.0);
+    gluPerspective(CAMERA_FOV_Y, (float)w / h, 0.1, 100.0);
     glMatrixMode(GL_MODELVIEW);
+    lodPixelScale = h / (2.0f * tan(CAMERA_FOV_Y * M_PI / 360.0));
+}
+
+// ------------------------------------------
+// Benchmark mode (--benchmark)
+// ------------------------------------------
+// Drives the orbit camera along a path with a fixed timestep, without input or
+// the idle loop, and writes frame-time percentiles, load time and memory as JSON.
+// Every render path is run over the same frames from the same starting state.
+// GLUT still needs a display for its context; on a headless machine run under Xvfb.
+struct CameraKey {
+    float time;             // Seconds from the start of the path
+    float angle, height, dist;
+};
+
+struct BenchmarkOptions {
+    int frames = 600;
+    int warmup = 60;                    // Unmeasured frames at the path start, per mode
+    float timestep = 1.0f / 60.0f;
+    std::string pathFile;               // Recorded path (--record-path); empty = built-in orbit
+    std::vector<std::string> modes = { "legacy", "instanced", "clustered" };
+    std::string output = "benchmark.json";
+    std::string trace;                  // Optional profiler capture of the run
+    int width = 1024, height = 768;
+};
+
+// One key per line: "time angle height dist" ('#' starts a comment)
+bool LoadCameraPath(const std::string& path, std::vector<CameraKey>& keys) {
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) { std::cerr << "Cannot open camera path " << path << std::endl; return false; }
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        CameraKey k;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%f %f %f %f", &k.time, &k.angle, &k.height, &k.dist) == 4) keys.push_back(k);
+    }
+    fclose(f);
+    if (keys.empty()) std::cerr << "Camera path " << path << " has no keys" << std::endl;
+    return !keys.empty();
+}
+
+// One full orbit over the run, swinging in and out and up and down twice
+std::vector<CameraKey> OrbitCameraPath(float duration) {
+    std::vector<CameraKey> keys;
+    const int STEPS = 64;
+    for (int i = 0; i <= STEPS; i++) {
+        float u = (float)i / STEPS;
+        keys.push_back({ u * duration, u * 2.0f * (float)M_PI, 5.0f + 2.0f * sinf(u * 4.0f * (float)M_PI), 15.0f + 5.0f * sinf(u * 4.0f * (float)M_PI + 1.0f) });
+    }
+    return keys;
+}
+
+// Linear between keys; a path shorter than the run loops
+void SampleCameraPath(const std::vector<CameraKey>& keys, float t) {
+    float length = keys.back().time;
+    if (length > 0.0f) t = fmodf(t, length);
+    size_t i = 1;
+    while (i < keys.size() && keys[i].time < t) i++;
+    const CameraKey& b = keys[std::min(i, keys.size() - 1)];
+    const CameraKey& a = keys[i - 1];
+    float span = b.time - a.time;
+    float u = span > 0.0f ? std::min(std::max((t - a.time) / span, 0.0f), 1.0f) : 0.0f;
+    cameraAngle = a.angle + (b.angle - a.angle) * u;
+    cameraHeight = a.height + (b.height - a.height) * u;
+    cameraDist = a.dist + (b.dist - a.dist) * u;
+}
+
+// Nearest-rank percentile of sorted values
+float Percentile(const std::vector<float>& sorted, float p) {
+    if (sorted.empty()) return 0.0f;
+    size_t rank = (size_t)ceil(p / 100.0f * sorted.size());
+    return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+struct BenchmarkResult {
+    std::string mode;
+    bool supported = true;
+    std::vector<float> frameMs;         // Update + display + glFinish
+    std::vector<float> cpuMs;           // Update + display (before the GPU finishes)
+    double drawCalls = 0, triangles = 0, visible = 0, occluded = 0;   // Per-frame averages
+};
+
+size_t PeakResidentBytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return std::max((size_t)usage.ru_maxrss * 1024, ResidentBytes()); // ru_maxrss is in kilobytes and lags the current size
+}
+
+bool WriteBenchmarkJson(const std::string& path, const std::string& scenePath, const BenchmarkOptions& opt,
+                        double loadMs, const std::vector<BenchmarkResult>& results) {
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) return false;
+    fputs("{\n  \"scene\": ", f);
+    WriteJsonString(f, scenePath);
+    fprintf(f, ",\n  \"frames\": %d,\n  \"warmup\": %d,\n  \"timestep\": %g,\n  \"path\": ", opt.frames, opt.warmup, opt.timestep);
+    WriteJsonString(f, opt.pathFile.empty() ? "orbit" : opt.pathFile);
+    fprintf(f, ",\n  \"window\": [%d, %d],\n  \"nodes\": %u,\n", windowWidth, windowHeight, scene.Count());
+    fprintf(f, "  \"load\": { \"ms\": %.3f, \"models\": %zu, \"textures\": %zu },\n", loadMs, modelRegistry.Size(), textureRegistry.Size());
+    fprintf(f, "  \"memory\": { \"gpuBufferBytes\": %zu, \"gpuTextureBytes\": %zu, \"rssBytes\": %zu, \"peakRssBytes\": %zu },\n",
+            gpuBufferBytes, gpuTextureBytes, ResidentBytes(), PeakResidentBytes());
+    fprintf(f, "  \"modes\": [");
+    for (size_t r = 0; r < results.size(); r++) {
+        const BenchmarkResult& res = results[r];
+        fprintf(f, "%s\n    { \"name\": ", r ? "," : "");
+        WriteJsonString(f, res.mode);
+        fprintf(f, ", \"supported\": %s", res.supported ? "true" : "false");
+        if (res.supported && !res.frameMs.empty()) {
+            std::vector<float> frame = res.frameMs, cpu = res.cpuMs;
+            std::sort(frame.begin(), frame.end());
+            std::sort(cpu.begin(), cpu.end());
+            double sum = 0.0, cpuSum = 0.0;
+            for (float ms : frame) sum += ms;
+            for (float ms : cpu) cpuSum += ms;
+            fprintf(f, ",\n      \"frameMs\": { \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"min\": %.4f, \"max\": %.4f },",
+                    sum / frame.size(), Percentile(frame, 50), Percentile(frame, 90), Percentile(frame, 95), Percentile(frame, 99), frame.front(), frame.back());
+            fprintf(f, "\n      \"cpuMs\": { \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f },",
+                    cpuSum / cpu.size(), Percentile(cpu, 50), Percentile(cpu, 99));
+            fprintf(f, "\n      \"perFrame\": { \"drawCalls\": %.1f, \"triangles\": %.1f, \"visibleObjects\": %.1f, \"occludedObjects\": %.1f } }",
+                    res.drawCalls, res.triangles, res.visible, res.occluded);
+        } else {
+            fprintf(f, " }");
+        }
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+// Returns the process exit code (0 = ran and wrote the results)
+int RunBenchmark(const std::string& scenePath, const BenchmarkOptions& opt) {
+    reshape(opt.width, opt.height);
+    SetVSync(false);
+
+    double loadStart = NowSeconds();
+    if (!LoadScene(scenePath)) { std::cerr << "Benchmark: could not load " << scenePath << std::endl; return 1; }
+    while (pendingAssets > 0) {
+        if (!PumpUploadQueue()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double loadMs = (NowSeconds() - loadStart) * 1000.0;
+
+    std::vector<CameraKey> path;
+    if (opt.pathFile.empty()) path = OrbitCameraPath(opt.frames * opt.timestep);
+    else if (!LoadCameraPath(opt.pathFile, path)) return 1;
+
+    // Same start for every mode: animation state and no selection (its pulse runs on wall time)
+    selectedObject = ObjectHandle();
+    isRoomSpinning = false;
+    isClockAnimating = true;
+    std::vector<float> startX = scene.rotX, startY = scene.rotY, startZ = scene.rotZ;
+
+    std::vector<BenchmarkResult> results;
+    for (const std::string& mode : opt.modes) {
+        BenchmarkResult res;
+        res.mode = mode;
+        if (mode == "legacy") useInstancing = false;
+        else if (mode == "instanced") { useInstancing = true; useClusteredLighting = false; res.supported = instancingSupported; }
+        else { useInstancing = true; useClusteredLighting = true; res.supported = instancingSupported && clusteredSupported; }
+        if (!res.supported) {
+            std::cout << "Benchmark " << mode << ": not supported by this GL" << std::endl;
+            results.push_back(res);
+            continue;
+        }
+
+        scene.rotX = startX; scene.rotY = startY; scene.rotZ = startZ;
+        for (uint32_t i = 0; i < scene.Count(); i++) MarkDirty(i);
+        SampleCameraPath(path, 0.0f);
+        for (int f = 0; f < opt.warmup; f++) { display(); glFinish(); }
+
+        for (int f = 0; f < opt.frames; f++) {
+            SampleCameraPath(path, f * opt.timestep);
+            double t0 = NowSeconds();
+            Update(opt.timestep);
+            display();
+            double t1 = NowSeconds();
+            glFinish();
+            double t2 = NowSeconds();
+            res.frameMs.push_back((t2 - t0) * 1000.0);
+            res.cpuMs.push_back((t1 - t0) * 1000.0);
+            res.drawCalls += renderStats.drawCalls;
+            res.triangles += renderStats.triangles;
+            res.visible += visibleObjects.size();
+            res.occluded += renderStats.occluded;
+        }
+        res.drawCalls /= opt.frames;
+        res.triangles /= opt.frames;
+        res.visible /= opt.frames;
+        res.occluded /= opt.frames;
+
+        std::vector<float> sorted = res.frameMs;
+        std::sort(sorted.begin(), sorted.end());
+        std::cout << "Benchmark " << mode << ": p50 " << Percentile(sorted, 50) << " ms, p99 " << Percentile(sorted, 99)
+                  << " ms, max " << sorted.back() << " ms (" << res.drawCalls << " draws, " << res.triangles << " tris per frame)" << std::endl;
+        results.push_back(res);
+    }
+
+    if (!opt.trace.empty()) profiler.WriteTrace(opt.trace);
+    if (!WriteBenchmarkJson(opt.output, scenePath, opt, loadMs, results)) {
+        std::cerr << "Benchmark: could not write " << opt.output << std::endl;
+        return 1;
+    }
+    std::cout << "Benchmark results written to " << opt.output << " (load " << loadMs << " ms)" << std::endl;
+    return 0;
+}
+
+// ------------------------------------------
+// Image writers (--render output)
+// ------------------------------------------
+// PNG: Paeth-filtered RGB rows, deflated with a small LZ77 matcher and the fixed
+// Huffman codes. That is not zlib's ratio, but it needs no library, and renders
+// (flat backgrounds, smooth shading) still shrink a lot. PPM: raw RGB, for when
+// the disk is faster than the encoders. Both take glReadPixels' bottom-up RGBA.
+uint32_t Crc32(const uint8_t* data, size_t n, uint32_t crc = 0) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t k = 0; k < 256; k++) {
+            uint32_t c = k;
+            for (int b = 0; b < 8; b++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[k] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t Adler32(const uint8_t* data, size_t n) {
+    uint32_t a = 1, b = 0;
+    while (n > 0) {
+        size_t chunk = std::min<size_t>(n, 5552); // Largest run before the sums can overflow
+        for (size_t i = 0; i < chunk; i++) { a += data[i]; b += a; }
+        a %= 65521;
+        b %= 65521;
+        data += chunk;
+        n -= chunk;
+    }
+    return (b << 16) | a;
+}
+
+// LSB-first bit packing as deflate wants it
+struct BitWriter {
+    std::vector<uint8_t>& out;
+    uint64_t bits = 0;
+    int count = 0;
+
+    explicit BitWriter(std::vector<uint8_t>& o) : out(o) {}
+
+    void Put(uint32_t value, int n) {
+        bits |= (uint64_t)value << count;
+        count += n;
+        while (count >= 8) {
+            out.push_back(bits & 0xFF);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+
+    void Flush() {
+        if (count > 0) out.push_back(bits & 0xFF);
+        bits = 0;
+        count = 0;
+    }
+};
+
+// Fixed Huffman code of a literal/length symbol, bit-reversed (Huffman codes go MSB first)
+struct FixedCode {
+    uint16_t bits;
+    uint8_t length;
+};
+
+const FixedCode& FixedLiteralCode(int symbol) {
+    static const std::vector<FixedCode> table = [] {
+        std::vector<FixedCode> t(288);
+        for (int s = 0; s < 288; s++) {
+            uint32_t code, len;
+            if (s < 144) { code = 0x30 + s; len = 8; }
+            else if (s < 256) { code = 0x190 + s - 144; len = 9; }
+            else if (s < 280) { code = s - 256; len = 7; }
+            else { code = 0xC0 + s - 280; len = 8; }
+            uint32_t rev = 0;
+            for (uint32_t b = 0; b < len; b++) rev |= ((code >> b) & 1) << (len - 1 - b);
+            t[s] = { (uint16_t)rev, (uint8_t)len };
+        }
+        return t;
+    }();
+    return table[symbol];
+}
+
+// One final fixed-Huffman block. Matches come from 3-byte hash chains over the 32 KB
+// window, longest of the first DEFLATE_MAX_CHAIN candidates, no lazy matching.
+void DeflateFixed(const uint8_t* data, size_t n, std::vector<uint8_t>& out) {
+    static const uint16_t LEN_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t LEN_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8_t DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    const size_t WINDOW = 32768, MAX_MATCH = 258;
+    const int HASH_BITS = 15, DEFLATE_MAX_CHAIN = 32;
+
+    std::vector<int32_t> head(1 << HASH_BITS, -1), prev(WINDOW, -1);
+    auto hash = [&](size_t p) { return ((data[p] << 10) ^ (data[p + 1] << 5) ^ data[p + 2]) & ((1 << HASH_BITS) - 1); };
+    auto insert = [&](size_t p) {
+        if (p + 2 >= n) return;
+        uint32_t h = hash(p);
+        prev[p & (WINDOW - 1)] = head[h];
+        head[h] = p;
+    };
+    auto putSymbol = [](BitWriter& w, int symbol) {
+        const FixedCode& c = FixedLiteralCode(symbol);
+        w.Put(c.bits, c.length);
+    };
+
+    BitWriter w(out);
+    w.Put(1, 1);    // BFINAL
+    w.Put(1, 2);    // BTYPE = fixed Huffman
+    size_t i = 0;
+    while (i < n) {
+        size_t bestLen = 0, bestDist = 0;
+        if (i + 2 < n) {
+            size_t maxLen = std::min(MAX_MATCH, n - i);
+            int chain = DEFLATE_MAX_CHAIN;
+            for (int32_t cand = head[hash(i)]; cand >= 0 && i - cand <= WINDOW && chain-- > 0; cand = prev[cand & (WINDOW - 1)]) {
+                const uint8_t* a = data + cand;
+                const uint8_t* b = data + i;
+                if (a[bestLen] != b[bestLen]) continue;
+                size_t len = 0;
+                while (len < maxLen && a[len] == b[len]) len++;
+                if (len > bestLen) {
+                    bestLen = len;
+                    bestDist = i - cand;
+                    if (len == maxLen) break;
+                }
+            }
+        }
+
+        if (bestLen >= 3) {
+            int l = std::upper_bound(LEN_BASE, LEN_BASE + 29, bestLen) - LEN_BASE - 1;
+            putSymbol(w, 257 + l);
+            w.Put(bestLen - LEN_BASE[l], LEN_EXTRA[l]);
+            int d = std::upper_bound(DIST_BASE, DIST_BASE + 30, bestDist) - DIST_BASE - 1;
+            uint32_t rev = 0;
+            for (int b = 0; b < 5; b++) rev |= ((d >> b) & 1) << (4 - b); // Fixed 5-bit distance code
+            w.Put(rev, 5);
+            w.Put(bestDist - DIST_BASE[d], DIST_EXTRA[d]);
+            for (size_t p = i; p < i + bestLen; p++) insert(p);
+            i += bestLen;
+        } else {
+            putSymbol(w, data[i]);
+            insert(i);
+            i++;
+        }
+    }
+    putSymbol(w, 256);  // End of block
+    w.Flush();
+}
+
+void PutBigEndian(std::vector<uint8_t>& out, uint32_t v) {
+    for (int s = 24; s >= 0; s -= 8) out.push_back((v >> s) & 0xFF);
+}
+
+void PutPngChunk(std::vector<uint8_t>& out, const char type[4], const std::vector<uint8_t>& data) {
+    PutBigEndian(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    PutBigEndian(out, Crc32(&out[start], out.size() - start));
+}
+
+bool WriteFile(const std::string& path, const uint8_t* data, size_t n) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(data, 1, n, f) == n;
+    return (fclose(f) == 0) && ok;
+}
+
+bool WritePng(const std::string& path, const uint8_t* rgba, int width, int height) {
+    size_t stride = 3 * (size_t)width;
+    std::vector<uint8_t> filtered((stride + 1) * height);
+    std::vector<uint8_t> row(stride), above(stride, 0);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src = rgba + (size_t)(height - 1 - y) * width * 4; // PNG is top row first
+        for (int x = 0; x < width; x++) memcpy(&row[3 * x], src + 4 * x, 3);
+        uint8_t* dst = &filtered[y * (stride + 1)];
+        dst[0] = 4; // Paeth
+        for (size_t k = 0; k < stride; k++) {
+            int a = k >= 3 ? row[k - 3] : 0, b = above[k], c = k >= 3 ? above[k - 3] : 0;
+            int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+            int predicted = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+            dst[1 + k] = row[k] - predicted;
+        }
+        row.swap(above);
+    }
+
+    std::vector<uint8_t> ihdr;
+    PutBigEndian(ihdr, width);
+    PutBigEndian(ihdr, height);
+    ihdr.insert(ihdr.end(), { 8, 2, 0, 0, 0 }); // 8-bit RGB, deflate, adaptive filters, no interlace
+
+    std::vector<uint8_t> idat = { 0x78, 0x01 }; // zlib header: deflate, 32 KB window
+    DeflateFixed(filtered.data(), filtered.size(), idat);
+    PutBigEndian(idat, Adler32(filtered.data(), filtered.size()));
+
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    std::vector<uint8_t> png(SIGNATURE, SIGNATURE + 8);
+    PutPngChunk(png, "IHDR", ihdr);
+    PutPngChunk(png, "IDAT", idat);
+    PutPngChunk(png, "IEND", std::vector<uint8_t>());
+    return WriteFile(path, png.data(), png.size());
+}
+
+bool WritePpm(const std::string& path, const uint8_t* rgba, int width, int height) {
+    char header[64];
+    int headerLength = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    std::vector<uint8_t> ppm(header, header + headerLength);
+    ppm.reserve(headerLength + (size_t)width * height * 3);
+    for (int y = height - 1; y >= 0; y--) {
+        const uint8_t* src = rgba + (size_t)y * width * 4;
+        for (int x = 0; x < width; x++) ppm.insert(ppm.end(), src + 4 * x, src + 4 * x + 3);
+    }
+    return WriteFile(path, ppm.data(), ppm.size());
+}
+
+// ------------------------------------------
+// Offscreen render mode (--render)
+// ------------------------------------------
+// Renders a turntable (one full orbit, as isRoomSpinning turns it, at the scene's
+// camera height and distance) or a recorded camera path into an offscreen FBO at any
+// size, and writes every frame as an image. Frames leave the GPU through a ring of
+// pixel pack buffers: glReadPixels into a PBO only queues the copy, and the frame is
+// mapped RENDER_READBACK_RING - 1 frames later, when the GPU has long finished it,
+// so rendering and readback overlap instead of stalling on each other. The pixels
+// are copied out and encoded on the loader threads while the next frames render.
+struct RenderOptions {
+    std::string pattern;                // Output path with one printf %d for the frame number
+    int samples = 4;                    // MSAA samples (0 = off), clamped to GL_MAX_SAMPLES
+};
+
+const int RENDER_READBACK_RING = 3;                 // PBOs in flight
+const size_t RENDER_ENCODE_MEMORY = 512 << 20;      // Frames waiting for an encoder, at most
+
+// Number of %d in the pattern (flags / width allowed), -1 if it has any other conversion
+// (%% is fine)
+int FramePatternConversions(const std::string& pattern) {
+    int conversions = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if (pattern[i] != '%') continue;
+        if (++i < pattern.size() && pattern[i] == '%') continue;
+        while (i < pattern.size() && strchr("0-+ 123456789", pattern[i])) i++;
+        if (i >= pattern.size() || pattern[i] != 'd') return -1;
+        conversions++;
+    }
+    return conversions;
+}
+
+bool HasExtension(const std::string& path, const char* ext) {
+    size_t n = strlen(ext);
+    return path.size() >= n && path.compare(path.size() - n, n, ext) == 0;
+}
+
+// Color + depth renderbuffers; with MSAA a second, single-sample FBO receives the
+// resolve and is the one read back
+struct OffscreenTarget {
+    GLuint fbo = 0, color = 0, depth = 0;
+    GLuint resolveFbo = 0, resolveColor = 0;
+    int samples = 0;
+
+    bool Create(int width, int height, int requestedSamples) {
+        GLint maxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        samples = std::min(requestedSamples, (int)maxSamples);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        if (ok && samples > 0) {
+            glGenFramebuffers(1, &resolveFbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, resolveFbo);
+            glGenRenderbuffers(1, &resolveColor);
+            glBindRenderbuffer(GL_RENDERBUFFER, resolveColor);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveColor);
+            ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        return ok;
+    }
+
+    // Leaves the finished frame bound for reading (GL_READ_FRAMEBUFFER) and fbo for drawing
+    void Resolve(int width, int height) {
+        if (samples == 0) { glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo); return; }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFbo);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+    }
+
+    ~OffscreenTarget() {
+        GLuint buffers[3] = { color, depth, resolveColor };
+        GLuint fbos[2] = { fbo, resolveFbo };
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteRenderbuffers(3, buffers);
+        glDeleteFramebuffers(2, fbos);
+    }
+};
+
+// Hands frames to the loader threads for encoding. Frame memory is recycled, and no
+// more than maxFrames are held: when the encoders are the bottleneck, Acquire() waits.
+class FrameEncoder {
+public:
+    FrameEncoder(size_t frameBytes, size_t maxFrames) : frameBytes(frameBytes), maxFrames(maxFrames) {}
+
+    std::vector<uint8_t>* Acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (free.empty() && created == maxFrames) {
+            double start = NowSeconds();
+            cv.wait(lock, [this] { return !free.empty(); });
+            waitSeconds += NowSeconds() - start;
+        }
+        if (free.empty()) {
+            created++;
+            return new std::vector<uint8_t>(frameBytes);
+        }
+        std::vector<uint8_t>* pixels = free.back();
+        free.pop_back();
+        return pixels;
+    }
+
+    void Encode(std::vector<uint8_t>* pixels, const std::string& path, int width, int height) {
+        auto job = [this, pixels, path, width, height] {
+            ProfileScope scope("Encode frame", path);
+            bool ok = HasExtension(path, ".png") ? WritePng(path, pixels->data(), width, height)
+                                                 : WritePpm(path, pixels->data(), width, height);
+            if (!ok && !failed.exchange(true)) LogLine("Render: could not write " + path);
+            std::lock_guard<std::mutex> lock(mutex);
+            free.push_back(pixels);
+            cv.notify_all();
+        };
+        if (useAsyncLoading) loaderPool.Submit(job);
+        else job();
+    }
+
+    // Waits until every frame is written
+    void Finish() {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return free.size() == created; });
+    }
+
+    bool Failed() const { return failed; }
+    double WaitSeconds() const { return waitSeconds; }
+
+    ~FrameEncoder() {
+        Finish();
+        for (std::vector<uint8_t>* pixels : free) delete pixels;
+    }
+
+private:
+    size_t frameBytes, maxFrames;
+    size_t created = 0;
+    std::vector<std::vector<uint8_t>*> free;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<bool> failed{false};
+    double waitSeconds = 0.0;
+};
+
+struct ReadbackSlot {
+    GLuint pbo = 0;
+    GLsync fence = 0;
+    int frame = -1;     // Frame whose pixels are on their way into pbo
+};
+
+struct RenderTimings {
+    double gpuWait = 0.0;   // Blocked on a readback fence: the GPU is the bottleneck
+    double copy = 0.0;      // Mapped PBO -> encoder frame
+};
+
+// Maps the slot's finished readback and passes the pixels on to an encoder
+void CollectReadback(ReadbackSlot& slot, FrameEncoder& encoder, const RenderOptions& render,
+                     int width, int height, RenderTimings& timings) {
+    if (slot.frame < 0) return;
+    double start = NowSeconds();
+    if (slot.fence) {
+        while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+    }
+    double mapped = NowSeconds();
+    timings.gpuWait += mapped - start;
+
+    std::vector<uint8_t>* pixels = encoder.Acquire();
+    double copyStart = NowSeconds();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+    if (const void* src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixels->size(), GL_MAP_READ_BIT)) {
+        memcpy(pixels->data(), src, pixels->size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    timings.copy += NowSeconds() - copyStart;
+
+    char path[4096];
+    snprintf(path, sizeof(path), render.pattern.c_str(), slot.frame);
+    encoder.Encode(pixels, path, width, height);
+    slot.frame = -1;
+}
+
+// Returns the process exit code (0 = every frame was written)
+int RunOffscreenRender(const std::string& scenePath, const BenchmarkOptions& opt, const RenderOptions& render) {
+    int width = opt.width, height = opt.height;
+    if (!HasGLVersion(3, 0)) { std::cerr << "Render: needs GL 3.0 (framebuffer objects)" << std::endl; return 1; }
+    GLint maxSize = 0, maxViewport[2] = { 0, 0 };
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxSize);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    if (width < 1 || height < 1 || width > std::min(maxSize, maxViewport[0]) || height > std::min(maxSize, maxViewport[1])) {
+        std::cerr << "Render: " << width << "x" << height << " is outside what this GL supports ("
+                  << std::min(maxSize, maxViewport[0]) << "x" << std::min(maxSize, maxViewport[1]) << ")" << std::endl;
+        return 1;
+    }
+
+    OffscreenTarget target;
+    if (!target.Create(width, height, render.samples)) { std::cerr << "Render: could not create the framebuffer" << std::endl; return 1; }
+    reshape(width, height);
+
+    if (!LoadScene(scenePath)) { std::cerr << "Render: could not load " << scenePath << std::endl; return 1; }
+    while (pendingAssets > 0) {
+        if (!PumpUploadQueue()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Turntable from the scene's camera, or the recorded path at its own pace
+    std::vector<CameraKey> path;
+    if (!opt.pathFile.empty() && !LoadCameraPath(opt.pathFile, path)) return 1;
+    float startAngle = cameraAngle;
+    selectedObject = ObjectHandle(); // The highlight pulses on wall time
+    isRoomSpinning = false;
+
+    bool fences = HasGLVersion(3, 2);
+    size_t frameBytes = (size_t)width * height * 4;
+    ReadbackSlot slots[RENDER_READBACK_RING];
+    for (ReadbackSlot& slot : slots) {
+        glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    unsigned int encoders = std::max(1u, std::thread::hardware_concurrency());
+    size_t maxFrames = std::max<size_t>(2, std::min<size_t>(2 * encoders, RENDER_ENCODE_MEMORY / frameBytes));
+    FrameEncoder encoder(frameBytes, maxFrames);
+    RenderTimings timings;
+
+    std::cout << "Rendering " << opt.frames << " frames at " << width << "x" << height << " ("
+              << (target.samples ? std::to_string(target.samples) + "x MSAA" : std::string("no MSAA")) << ") to " << render.pattern << std::endl;
+    double start = NowSeconds();
+    for (int f = 0; f < opt.frames && !encoder.Failed(); f++) {
+        if (path.empty()) cameraAngle = startAngle + 2.0f * (float)M_PI * f / opt.frames;
+        else SampleCameraPath(path, f * opt.timestep);
+
+        profiler.BeginFrame();
+        Update(opt.timestep);
+        RenderFrame();
+        target.Resolve(width, height);
+
+        // The slot's previous frame was queued RENDER_READBACK_RING frames ago
+        ReadbackSlot& slot = slots[f % RENDER_READBACK_RING];
+        CollectReadback(slot, encoder, render, width, height, timings);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (fences) slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.frame = f;
+        glFlush(); // Start the GPU on it now, not when the ring comes back around
+        profiler.EndFrame(renderStats, visibleObjects.size(), gpuBufferBytes + gpuTextureBytes);
+
+        if ((f + 1) % 100 == 0) std::cout << "  " << f + 1 << " / " << opt.frames << std::endl;
+    }
+    for (int k = 0; k < RENDER_READBACK_RING; k++) {
+        // Oldest first, so frames reach the encoders in order
+        int f = opt.frames + k;
+        CollectReadback(slots[f % RENDER_READBACK_RING], encoder, render, width, height, timings);
+    }
+    double rendered = NowSeconds();
+    encoder.Finish();
+    double finished = NowSeconds();
+
+    for (ReadbackSlot& slot : slots) glDeleteBuffers(1, &slot.pbo);
+    if (!opt.trace.empty()) profiler.WriteTrace(opt.trace);
+    if (encoder.Failed()) return 1;
+
+    double seconds = finished - start;
+    std::cout << "Rendered " << opt.frames << " frames in " << seconds << " s (" << opt.frames / seconds << " fps); "
+              << "waited " << timings.gpuWait * 1000.0 << " ms on readbacks, " << encoder.WaitSeconds() * 1000.0
+              << " ms on encoders, copied for " << timings.copy * 1000.0 << " ms, last encodes took "
+              << (finished - rendered) * 1000.0 << " ms" << std::endl;
+    return 0;
+}
+
+// [scene] [--benchmark] [--frames N] [--warmup N] [--dt S] [--path FILE] [--modes a,b]
+// [--out FILE] [--trace FILE] [--size WxH] [--record-path FILE] [--no-hot-reload]
+// [--render PATTERN] [--samples N]   (--frames / --dt / --path / --size / --trace apply to --render too)
+bool ParseArguments(int argc, char** argv, std::string& scenePath, bool& benchmark, BenchmarkOptions& opt, std::string& recordPath,
+                    RenderOptions& render) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--benchmark") benchmark = true;
+        else if (arg == "--frames" && hasValue) opt.frames = std::max(1, atoi(argv[++i]));
+        else if (arg == "--warmup" && hasValue) opt.warmup = std::max(0, atoi(argv[++i]));
+        else if (arg == "--dt" && hasValue) opt.timestep = atof(argv[++i]);
+        else if (arg == "--path" && hasValue) opt.pathFile = argv[++i];
+        else if (arg == "--out" && hasValue) opt.output = argv[++i];
+        else if (arg == "--trace" && hasValue) opt.trace = argv[++i];
+        else if (arg == "--record-path" && hasValue) recordPath = argv[++i];
+        else if (arg == "--no-hot-reload") useHotReload = false;
+        else if (arg == "--render" && hasValue) render.pattern = argv[++i];
+        else if (arg == "--samples" && hasValue) render.samples = std::max(0, atoi(argv[++i]));
+        else if (arg == "--size" && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &opt.width, &opt.height) != 2) { std::cerr << "Bad --size " << argv[i] << std::endl; return false; }
+        } else if (arg == "--modes" && hasValue) {
+            opt.modes.clear();
+            std::stringstream list(argv[++i]);
+            std::string mode;
+            while (std::getline(list, mode, ',')) {
+                if (mode != "legacy" && mode != "instanced" && mode != "clustered") { std::cerr << "Unknown benchmark mode " << mode << std::endl; return false; }
+                opt.modes.push_back(mode);
+            }
+        } else if (arg[0] != '-') scenePath = arg;
+        else { std::cerr << "Unknown or incomplete option " << arg << std::endl; return false; }
+    }
+    if (opt.timestep <= 0.0f) { std::cerr << "--dt must be positive" << std::endl; return false; }
+    if (!render.pattern.empty()) {
+        int conversions = FramePatternConversions(render.pattern);
+        if (conversions < 0 || conversions > 1 || (conversions == 0 && opt.frames > 1)) {
+            std::cerr << "--render needs one %d for the frame number (e.g. frames/turntable_%04d.png)" << std::endl;
+            return false;
+        }
+        if (!HasExtension(render.pattern, ".png") && !HasExtension(render.pattern, ".ppm")) {
+            std::cerr << "--render writes .png or .ppm" << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
 
 int main(int argc, char** argv) {
-    glutInit(&argc, argv);
+    glutInit(&argc, argv); // Takes its own X options out of argv
+    std::string scenePath = "scene.json";
+    std::string recordPath;
+    bool benchmark = false;
+    BenchmarkOptions bench;
+    RenderOptions render;
+    if (!ParseArguments(argc, argv, scenePath, benchmark, bench, recordPath, render)) return 2;
+    bool offscreen = !render.pattern.empty();
+
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(1024, 768);
+    if (offscreen) glutInitWindowSize(64, 64); // Only for the GL context; frames go to an FBO
+    else glutInitWindowSize(benchmark ? bench.width : 1024, benchmark ? bench.height : 768);
     glutCreateWindow("Final Room Project");
 
+    NameProfilerThread("GLUT"); // First profiled thread, before the loaders exist
     init();
-    LoadScene();
+    if (useAsyncLoading) loaderPool.Start(std::thread::hardware_concurrency());
+    frameJobs.Start(std::max(1u, std::thread::hardware_concurrency()) - 1); // + the GLUT thread
+    importJobs.Start(std::max(1u, std::thread::hardware_concurrency()) - 1); // + the calling loader
+    if (offscreen) return RunOffscreenRender(scenePath, bench, render);
+    if (benchmark) return RunBenchmark(scenePath, bench);
+
+    if (useHotReload) StartHotReload(); // Before the scene, so its files get watched
+    LoadScene(scenePath);
+    if (!recordPath.empty()) {
+        cameraRecordFile = fopen(recordPath.c_str(), "w");
+        if (cameraRecordFile) fprintf(cameraRecordFile, "# time angle height dist\n");
+        cameraRecordStart = NowSeconds();
+    }
 
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
     glutKeyboardFunc(keyboard);
     glutSpecialFunc(specialKeys);
-    glutIdleFunc(idle);
+    glutMouseFunc(mouse);
+    WakeIdle();
+    SetVSync(useVSync);
     
-    std::cout << "CONTROLS:\nArrows: Manual Camera\nENTER: Toggle 360 View\nTAB: Select Object\nWASD/QE: Move Object\nRF/TG/YH: Rotate Object\nSpace: Pause Clock\n";
+    std::cout << "CONTROLS:\nArrows: Manual Camera\nENTER: Toggle 360 View\nTAB / Left Click: Select Object\nWASD/QE: Move Object\nRF/TG/YH: Rotate Object\nSpace: Pause Clock\nI: Toggle Instancing\nC: Toggle Frustum Culling\nK: Toggle BVH Culling\nX: Toggle Occlusion Culling\nZ: Toggle Static Batching\nM: Toggle SIMD Transforms\nB: Print Draw Stats\nL: Toggle Clustered Lighting\nO: Toggle Mesh LODs\nV: Toggle VSync\nP: Toggle Profiler HUD\nCtrl+P: Save Profile (profile.json)\nCtrl+S: Save Scene (.scnb)\nCtrl+R: Reload Scene\n";
 
     glutMainLoop();
     return 0;